@@ -0,0 +1,464 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "audit.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <syslog.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+
+#ifndef AUDIT_JOURNAL
+# define AUDIT_JOURNAL  "/var/log/total-lockdown.log"
+#endif
+
+
+/**
+ * The number of events the ring can hold, must be a power of two
+ */
+#define AUDIT_RING_SIZE  64
+
+/**
+ * How many milliseconds the writer waits for an event that has
+ * been claimed but not written before it skips it, its producer
+ * has probably been killed while writing it
+ */
+#define AUDIT_STALE_MS  1000
+
+
+
+/**
+ * A recorded unlock attempt, it does not contain
+ * anything derived from the passphrase except the
+ * magnitude of its length
+ */
+struct audit_event
+{
+  /**
+   * When the attempt was verified
+   */
+  struct timespec time;
+  
+  /**
+   * The attempt's ordinal, starting at 1
+   */
+  unsigned long attempt;
+  
+  /**
+   * `AUDIT_SUCCESS`, `AUDIT_FAILURE` or `AUDIT_ERROR`
+   */
+  int verdict;
+  
+  /**
+   * 0 for an empty passphrase, otherwise the length is
+   * in [2 ↑ (bucket − 1), 2 ↑ bucket)
+   */
+  int length_bucket;
+  
+  /**
+   * The slot's ordinal in the ring plus 1, set once the
+   * event has been written, so that the writer does not
+   * read an event that a producer has claimed but not
+   * finished writing
+   */
+  volatile unsigned long ready;
+};
+
+
+/**
+ * Event ring shared between all processes in the lock, and
+ * between all locks started by the daemon, so there may be
+ * several producers at a time, which claim slots by advancing
+ * `head` atomically, and the writer is the only consumer
+ */
+struct audit_ring
+{
+  /**
+   * The number of slots ever claimed by producers
+   */
+  volatile unsigned long head;
+  
+  /**
+   * The number of events ever flushed, only written by the writer
+   */
+  volatile unsigned long tail;
+  
+  /**
+   * The number of attempts made
+   */
+  volatile unsigned long attempts;
+  
+  /**
+   * The number of events dropped because the ring was full
+   */
+  volatile unsigned long dropped;
+  
+  /**
+   * The events, indexed by their ordinal modulo `AUDIT_RING_SIZE`
+   */
+  struct audit_event events[AUDIT_RING_SIZE];
+};
+
+
+
+/**
+ * The shared event ring, `NULL` if auditing is not running
+ */
+static struct audit_ring* ring = NULL;
+
+/**
+ * Non-blocking write end of the pipe used to wake the writer
+ */
+static int notify_fd = -1;
+
+
+
+/**
+ * Get the magnitude of a length
+ * 
+ * @param   length  The length
+ * @return          The number of bits needed to store `length`
+ */
+static int __attribute__((const)) length_bucket(size_t length)
+{
+  int bucket = 0;
+  while (length)
+    bucket++, length >>= 1;
+  return bucket;
+}
+
+
+/**
+ * Format an event as a line of text
+ * 
+ * @param   buf    The output buffer
+ * @param   size   The size of `buf`
+ * @param   event  The event
+ * @return         The length of the line
+ */
+static size_t format_event(char* buf, size_t size, const struct audit_event* event)
+{
+  static const char* verdicts[] = {
+    [AUDIT_SUCCESS] = "success",
+    [AUDIT_FAILURE] = "failure",
+    [AUDIT_ERROR]   = "error"
+  };
+  char timestamp[sizeof("YYYY-MM-DDThh:mm:ssZ")];
+  char length[64];
+  struct tm tm;
+  int n;
+  
+  gmtime_r(&(event->time.tv_sec), &tm);
+  strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &tm);
+  
+  if (event->length_bucket == 0)
+    strcpy(length, "0");
+  else
+    sprintf(length, "%zu-%zu", (size_t)1 << (event->length_bucket - 1),
+	    ((size_t)1 << (event->length_bucket - 1) << 1) - 1);
+  
+  n = snprintf(buf, size, "%s attempt=%lu verdict=%s length=%s\n", timestamp,
+	       event->attempt, verdicts[event->verdict], length);
+  return n < 0 ? 0 : (size_t)n < size ? (size_t)n : size - 1;
+}
+
+
+/**
+ * Write out a line to the journal or to syslog
+ * 
+ * @param  journal  The journal's file descriptor, -1 for syslog
+ * @param  line     The line, including the terminating LF
+ * @param  n        The length of the line
+ */
+static void emit_line(int journal, const char* line, size_t n)
+{
+  ssize_t wrote;
+  if (journal < 0)
+    {
+      syslog(LOG_NOTICE, "%.*s", (int)n - 1, line);
+      return;
+    }
+  while (n)
+    {
+      wrote = write(journal, line, n);
+      if (wrote < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  break;
+	}
+      n -= (size_t)wrote;
+      line += (size_t)wrote;
+    }
+}
+
+
+/**
+ * Flush all pending events in one batch, stopping at the first
+ * event that has been claimed but not written, the producer
+ * wakes the writer again once it has written it
+ * 
+ * @param   journal           The journal's file descriptor, -1 for syslog
+ * @param   reported_dropped  The number of dropped events that have been reported
+ * @param   skip              The number of unfinished events to skip, and count
+ *                            as dropped, because their producers have died
+ * @return                    Whether an unfinished event is left
+ */
+static int flush_events(int journal, unsigned long* reported_dropped, size_t skip)
+{
+  static char batch[AUDIT_RING_SIZE * 128 + 128];
+  struct audit_event events[AUDIT_RING_SIZE];
+  unsigned long head, tail, dropped;
+  size_t i, n = 0, length = 0;
+  int unfinished = 0;
+  char* line;
+  
+  head = ring->head;
+  tail = ring->tail;
+  __sync_synchronize();
+  for (; tail != head; tail++)
+    {
+      if (ring->events[tail % AUDIT_RING_SIZE].ready != tail + 1)
+	{
+	  if (skip)
+	    {
+	      skip--;
+	      __sync_add_and_fetch(&(ring->dropped), 1);
+	      continue;
+	    }
+	  unfinished = 1;
+	  break;
+	}
+      __sync_synchronize();
+      events[n++] = ring->events[tail % AUDIT_RING_SIZE];
+    }
+  __sync_synchronize();
+  ring->tail = tail;
+  dropped = ring->dropped;
+  
+  for (i = 0; i < n; i++)
+    {
+      line = batch + (journal < 0 ? 0 : length);
+      length += format_event(line, 128, events + i);
+      if (journal < 0)
+	emit_line(journal, batch, length), length = 0;
+    }
+  
+  if (dropped != *reported_dropped)
+    {
+      line = batch + (journal < 0 ? 0 : length);
+      length += (size_t)sprintf(line, "dropped=%lu\n", dropped - *reported_dropped);
+      *reported_dropped = dropped;
+    }
+  
+  if (length)
+    {
+      emit_line(journal, batch, length);
+      if (journal >= 0)
+	fdatasync(journal);
+    }
+  
+  return unfinished;
+}
+
+
+/**
+ * Get the number of milliseconds left until an unfinished event is stale
+ * 
+ * @param   since  When the event was first seen unfinished
+ * @return         The number of milliseconds, zero if it is stale
+ */
+static int stale_in(const struct timespec* since)
+{
+  struct timespec now;
+  long long waited;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  waited = (long long)(now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000L;
+  return waited >= AUDIT_STALE_MS ? 0 : (int)(AUDIT_STALE_MS - waited);
+}
+
+
+/**
+ * The writer process, drains the ring each time it is
+ * woken up, and exits when the lock has ended
+ * 
+ * The writer only has a timeout while an event has been claimed
+ * but not written, otherwise a producer that is killed between
+ * claiming and writing would keep every later event from being
+ * written, and the ring would fill up and drop them
+ * 
+ * @param  journal  The journal's file descriptor, -1 for syslog
+ * @param  notify   The read end of the wake up pipe
+ */
+static void __attribute__((noreturn)) writer(int journal, int notify)
+{
+  unsigned long reported_dropped = 0, stalled_tail = 0;
+  struct timespec stalled_since;
+  struct pollfd fds[1];
+  char wakeups[64];
+  ssize_t got;
+  int ready, stalled = 0;
+  
+  if (journal < 0)
+    openlog("total-lockdown", LOG_NDELAY | LOG_PID, LOG_AUTHPRIV);
+  
+  /* we only need the journal, which we already have open */
+  if (setgid(getgid()) || setuid(getuid()))
+    _exit(1);
+  
+  fds[0].fd = notify, fds[0].events = POLLIN;
+  for (;;)
+    {
+      if ((ready = poll(fds, 1, stalled ? stale_in(&stalled_since) : -1)) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  ready = 1; /* let read tell us what is wrong */
+	}
+      got = 1;
+      if (ready && ((got = read(notify, wakeups, sizeof(wakeups))) < 0) && (errno == EINTR))
+	continue;
+      
+      /* once every process in the lock has exited, every unfinished event is
+       * skipped, otherwise only the first one, and only once it is stale */
+      if (!flush_events(journal, &reported_dropped, got <= 0 ? AUDIT_RING_SIZE : !ready))
+	stalled = 0;
+      else if (!stalled || (stalled_tail != ring->tail))
+	{
+	  stalled = 1;
+	  stalled_tail = ring->tail;
+	  clock_gettime(CLOCK_MONOTONIC, &stalled_since);
+	}
+      if (got <= 0)
+	break;
+    }
+  
+  _exit(0);
+}
+
+
+/**
+ * Open the audit journal, set up the shared event ring and
+ * start the writer process, must be called before any fork
+ * whose descendants record events, and before privileges
+ * are dropped
+ * 
+ * If this function fails, events are silently discarded
+ * 
+ * @return  Zero on success, -1 on error
+ */
+int audit_start(void)
+{
+  int journal = -1;
+  int fds_pipe[2];
+  pid_t pid;
+  void* shared;
+  
+#ifndef AUDIT_SYSLOG
+  journal = open(AUDIT_JOURNAL, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+  /* fall back to syslog if the journal cannot be opened */
+#endif
+  
+  shared = mmap(NULL, sizeof(struct audit_ring), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED)
+    goto fail;
+  
+  if (pipe(fds_pipe))
+    goto fail_unmap;
+  
+  if ((pid = fork()) == (pid_t)-1)
+    goto fail_close;
+  
+  ring = shared;
+  if (pid == 0)
+    {
+      close(fds_pipe[1]);
+      close(STDIN_FILENO);
+      writer(journal, fds_pipe[0]);
+    }
+  
+  close(fds_pipe[0]);
+  if (journal >= 0)
+    close(journal);
+  fcntl(fds_pipe[1], F_SETFL, O_NONBLOCK);
+  notify_fd = fds_pipe[1];
+  return 0;
+  
+ fail_close:
+  close(fds_pipe[0]);
+  close(fds_pipe[1]);
+ fail_unmap:
+  munmap(shared, sizeof(struct audit_ring));
+ fail:
+  if (journal >= 0)
+    close(journal);
+  return -1;
+}
+
+
+/**
+ * Record an unlock attempt, this function never blocks,
+ * if the ring is full the event is dropped and counted
+ * 
+ * @param  verdict  `AUDIT_SUCCESS`, `AUDIT_FAILURE` or `AUDIT_ERROR`
+ * @param  length   The length of the entered passphrase, only
+ *                  its magnitude is recorded
+ */
+void audit_attempt(int verdict, size_t length)
+{
+  struct audit_event* event;
+  unsigned long attempt, head;
+  
+  if (ring == NULL)
+    return;
+  
+  attempt = __sync_add_and_fetch(&(ring->attempts), 1);
+  do
+    {
+      head = ring->head;
+      if (head - ring->tail >= AUDIT_RING_SIZE)
+	{
+	  __sync_add_and_fetch(&(ring->dropped), 1);
+	  goto wake;
+	}
+    }
+  while (!__sync_bool_compare_and_swap(&(ring->head), head, head + 1));
+  
+  event = ring->events + (head % AUDIT_RING_SIZE);
+  clock_gettime(CLOCK_REALTIME, &(event->time));
+  event->attempt = attempt;
+  event->verdict = verdict;
+  event->length_bucket = length_bucket(length);
+  __sync_synchronize();
+  event->ready = head + 1;
+  
+ wake:
+  /* if the pipe is full the writer has already been woken up */
+  if (write(notify_fd, "", 1) < 0)
+    return;
+}
+
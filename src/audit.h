@@ -0,0 +1,68 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_AUDIT_H
+#define TOTAL_LOCKDOWN_AUDIT_H
+
+
+#include <stddef.h>
+
+
+
+/**
+ * The passphrase was correct
+ */
+#define AUDIT_SUCCESS  0
+
+/**
+ * The passphrase was incorrect
+ */
+#define AUDIT_FAILURE  1
+
+/**
+ * The passphrase could not be verified
+ */
+#define AUDIT_ERROR  2
+
+
+
+/**
+ * Open the audit journal, set up the shared event ring and
+ * start the writer process, must be called before any fork
+ * whose descendants record events, and before privileges
+ * are dropped
+ * 
+ * If this function fails, events are silently discarded
+ * 
+ * @return  Zero on success, -1 on error
+ */
+int audit_start(void);
+
+
+/**
+ * Record an unlock attempt, this function never blocks,
+ * if the ring is full the event is dropped and counted
+ * 
+ * @param  verdict  `AUDIT_SUCCESS`, `AUDIT_FAILURE` or `AUDIT_ERROR`
+ * @param  length   The length of the entered passphrase, only
+ *                  its magnitude is recorded
+ */
+void audit_attempt(int verdict, size_t length);
+
+
+#endif
+
@@ -0,0 +1,191 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "daemon.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+
+
+/**
+ * The first file descriptor passed by the service manager
+ */
+#define LISTEN_FDS_START  3
+
+/**
+ * How long a client may take to send its request, in
+ * seconds, the daemon serves one request at a time
+ */
+#define REQUEST_TIMEOUT  1
+
+
+
+/**
+ * Get the socket to listen for lock requests on, either passed
+ * by the service manager (socket activation) or bound to
+ * `DAEMON_SOCKET`, this must be done before privileges
+ * are dropped so that only root can connect
+ * 
+ * @return  The listening socket, -1 on error
+ */
+int daemon_listen(void)
+{
+  struct sockaddr_un address;
+  const char* listen_pid = getenv("LISTEN_PID");
+  const char* listen_fds = getenv("LISTEN_FDS");
+  mode_t saved_umask;
+  int fd;
+  
+  if (listen_pid && listen_fds && (atol(listen_pid) == (long)getpid()) && (atoi(listen_fds) >= 1))
+    {
+      unsetenv("LISTEN_PID");
+      unsetenv("LISTEN_FDS");
+      unsetenv("LISTEN_FDNAMES");
+      return LISTEN_FDS_START;
+    }
+  
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, DAEMON_SOCKET);
+  
+  if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+    return -1;
+  unlink(DAEMON_SOCKET);
+  saved_umask = umask(0077); /* root only */
+  if (bind(fd, (const struct sockaddr*)&address, sizeof(address)) || listen(fd, 8))
+    {
+      umask(saved_umask);
+      close(fd);
+      return -1;
+    }
+  umask(saved_umask);
+  return fd;
+}
+
+
+/**
+ * Wait for a lock request from root
+ * 
+ * @param   listener  The listening socket
+ * @param   vt        Output parameter for the VT to lock
+ * @return            The connection, the lock should write one line to it
+ *                    once the keyboard is grabbed, -1 on error, or with
+ *                    `errno` set to `EAGAIN` if the listener is non-blocking
+ *                    and there is no acceptable request
+ */
+int daemon_accept(int listener, int* vt)
+{
+  struct ucred credentials;
+  socklen_t length = sizeof(credentials);
+  struct timeval timeout = { REQUEST_TIMEOUT, 0 };
+  char request[16];
+  ssize_t got;
+  char* end;
+  long value;
+  int fd;
+  
+  for (;;)
+    {
+      if ((fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC)) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return -1;
+	}
+      
+      /* the socket is already root only, but be sure */
+      if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) || (credentials.uid != 0))
+	goto reject;
+      
+      /* the request is the VT number terminated by LF, a client that does
+       * not send it must not keep the daemon from serving anyone else */
+      if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)))
+	goto reject;
+      got = read(fd, request, sizeof(request) - 1);
+      if (got <= 0)
+	goto reject;
+      request[got] = '\0';
+      value = strtol(request, &end, 10);
+      if ((end == request) || ((*end != '\n') && (*end != '\0')) || (value < 1) || (value > 63))
+	goto reject;
+      
+      *vt = (int)value;
+      return fd;
+      
+    reject:
+      close(fd);
+    }
+}
+
+
+/**
+ * Ask the daemon to lock a VT and wait until it is locked
+ * 
+ * @param   vt  The VT to lock
+ * @return      Zero on success, -1 on error
+ */
+int daemon_request(int vt)
+{
+  struct sockaddr_un address;
+  char message[16];
+  ssize_t got;
+  int fd, n;
+  
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, DAEMON_SOCKET);
+  
+  if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+    return -1;
+  if (connect(fd, (const struct sockaddr*)&address, sizeof(address)))
+    goto fail;
+  
+  n = sprintf(message, "%i\n", vt);
+  if (write(fd, message, (size_t)n) != (ssize_t)n)
+    goto fail;
+  
+  /* the daemon replies when the keyboard is grabbed, and hangs up on failure */
+  while ((got = read(fd, message, sizeof(message))) < 0)
+    if (errno != EINTR)
+      goto fail;
+  if (got == 0)
+    {
+      errno = ECONNREFUSED;
+      goto fail;
+    }
+  
+  close(fd);
+  return 0;
+  
+ fail:
+  n = errno;
+  close(fd);
+  errno = n;
+  return -1;
+}
+
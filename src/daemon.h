@@ -0,0 +1,62 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_DAEMON_H
+#define TOTAL_LOCKDOWN_DAEMON_H
+
+
+#ifndef DAEMON_SOCKET
+# define DAEMON_SOCKET  "/run/total-lockdown.socket"
+#endif
+
+
+
+/**
+ * Get the socket to listen for lock requests on, either passed
+ * by the service manager (socket activation) or bound to
+ * `DAEMON_SOCKET`, this must be done before privileges
+ * are dropped so that only root can connect
+ * 
+ * @return  The listening socket, -1 on error
+ */
+int daemon_listen(void);
+
+
+/**
+ * Wait for a lock request from root
+ * 
+ * @param   listener  The listening socket
+ * @param   vt        Output parameter for the VT to lock
+ * @return            The connection, the lock should write one line to it
+ *                    once the keyboard is grabbed, -1 on error, or with
+ *                    `errno` set to `EAGAIN` if the listener is non-blocking
+ *                    and there is no acceptable request
+ */
+int daemon_accept(int listener, int* vt);
+
+
+/**
+ * Ask the daemon to lock a VT and wait until it is locked
+ * 
+ * @param   vt  The VT to lock
+ * @return      Zero on success, -1 on error
+ */
+int daemon_request(int vt);
+
+
+#endif
+
@@ -0,0 +1,296 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "idle.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <linux/input.h>
+
+
+#if defined(EBUG) && !defined(DEBUG)
+# define DEBUG
+#endif
+
+
+
+/**
+ * The maximum number of input devices that are watched
+ */
+#define MAX_DEVICES  64
+
+
+
+/**
+ * The opened input devices
+ */
+static int devices[MAX_DEVICES];
+
+/**
+ * The number of used elements in `devices`
+ */
+static size_t devices_count = 0;
+
+/**
+ * Watch for new input devices, -1 if not available
+ */
+static int inotify_fd = -1;
+
+#ifdef DEBUG
+/**
+ * The number of times the watcher has woken up
+ */
+static unsigned long wakeups = 0;
+#endif
+
+
+
+/**
+ * Open an input device, if it is an event device
+ * 
+ * @param  name  The name of the device in /dev/input
+ */
+static void open_device(const char* name)
+{
+  char path[sizeof("/dev/input/") + NAME_MAX];
+  int clock = CLOCK_MONOTONIC;
+  int fd;
+  
+  if (strncmp(name, "event", strlen("event")) || (devices_count == MAX_DEVICES))
+    return;
+  
+  sprintf(path, "/dev/input/%s", name);
+  if ((fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) < 0)
+    return;
+  ioctl(fd, EVIOCSCLOCKID, &clock); /* so we can compare with the timer */
+  devices[devices_count++] = fd;
+}
+
+
+/**
+ * Open input devices that have been plugged in
+ */
+static void open_new_devices(void)
+{
+  char buffer[sizeof(struct inotify_event) + NAME_MAX + 1] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct inotify_event* event;
+  ssize_t got;
+  size_t i;
+  
+  while ((got = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+    for (i = 0; i < (size_t)got; i += sizeof(struct inotify_event) + event->len)
+      {
+	event = (struct inotify_event*)(buffer + i);
+	if (event->len)
+	  {
+	    /* the device is created before its permissions are set, so we need our privileges */
+	    seteuid(0);
+	    open_device(event->name);
+	    seteuid(getuid());
+	  }
+      }
+}
+
+
+/**
+ * Read all pending events from the input devices
+ * 
+ * @param  latest  The time of the latest input, updated
+ *                 if there has been any input since
+ */
+static void drain_devices(struct timespec* latest)
+{
+  struct input_event events[64];
+  ssize_t got;
+  size_t i, j;
+  
+  for (i = 0; i < devices_count; i++)
+    {
+      while ((got = read(devices[i], events, sizeof(events))) > 0)
+	for (j = 0; j < (size_t)got / sizeof(*events); j++)
+	  if ((events[j].time.tv_sec > latest->tv_sec) ||
+	      ((events[j].time.tv_sec == latest->tv_sec) && (events[j].time.tv_usec * 1000L > latest->tv_nsec)))
+	    {
+	      latest->tv_sec = events[j].time.tv_sec;
+	      latest->tv_nsec = events[j].time.tv_usec * 1000L;
+	    }
+      
+      if ((got < 0) && (errno == ENODEV)) /* unplugged */
+	{
+	  close(devices[i]);
+	  devices[i--] = devices[--devices_count];
+	}
+    }
+}
+
+
+/**
+ * Open the input devices, this must be done before
+ * privileges are dropped
+ * 
+ * @return  Zero on success, -1 on error
+ */
+int idle_open(void)
+{
+  struct dirent* entry;
+  DIR* dir;
+  
+  if ((dir = opendir("/dev/input")) == NULL)
+    return -1;
+  while ((entry = readdir(dir)))
+    open_device(entry->d_name);
+  closedir(dir);
+  
+  inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd >= 0)
+    if (inotify_add_watch(inotify_fd, "/dev/input", IN_CREATE) < 0)
+      {
+	close(inotify_fd);
+	inotify_fd = -1;
+      }
+  
+  if (devices_count == 0)
+    {
+      errno = ENODEV;
+      return -1;
+    }
+  return 0;
+}
+
+
+/**
+ * Wait until no input has been made for a period of time
+ * 
+ * No input device is polled, the watcher only wakes up when
+ * the period could have expired, and then checks the time
+ * of the latest input event, so while the user is active it
+ * wakes up at most once per period
+ * 
+ * @param   seconds  The period of time
+ * @return           Zero on success, -1 on error
+ */
+int idle_wait(unsigned int seconds)
+{
+  struct epoll_event event;
+  struct itimerspec deadline;
+  struct timespec now, latest;
+  uint64_t expirations;
+  int timer_fd, epoll_fd = -1, saved_errno, n;
+  
+  if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+    return -1;
+  if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    goto fail;
+  
+  event.events = EPOLLIN;
+  event.data.fd = timer_fd;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event))
+    goto fail;
+  if (inotify_fd >= 0)
+    {
+      event.data.fd = inotify_fd;
+      if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inotify_fd, &event))
+	goto fail;
+    }
+  
+  /* input that has been made while we were locked does not count */
+  clock_gettime(CLOCK_MONOTONIC, &latest);
+  drain_devices(&(struct timespec){0, 0});
+  
+  memset(&deadline, 0, sizeof(deadline));
+  for (;;)
+    {
+      deadline.it_value = latest;
+      deadline.it_value.tv_sec += (time_t)seconds;
+      if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &deadline, NULL))
+	goto fail;
+      
+      n = epoll_wait(epoll_fd, &event, 1, -1);
+#ifdef DEBUG
+      wakeups++;
+#endif
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  goto fail;
+	}
+      if (n == 0)
+	continue;
+      
+      if (event.data.fd == inotify_fd)
+	{
+	  open_new_devices();
+	  continue;
+	}
+      
+      if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+	continue;
+      drain_devices(&latest);
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if ((now.tv_sec > latest.tv_sec + (time_t)seconds) ||
+	  ((now.tv_sec == latest.tv_sec + (time_t)seconds) && (now.tv_nsec >= latest.tv_nsec)))
+	break;
+    }
+  
+  close(epoll_fd);
+  close(timer_fd);
+  return 0;
+  
+ fail:
+  saved_errno = errno;
+  if (epoll_fd >= 0)
+    close(epoll_fd);
+  close(timer_fd);
+  errno = saved_errno;
+  return -1;
+}
+
+
+#ifdef DEBUG
+/**
+ * Print the number of times the watcher has woken up
+ * and how much CPU time the process has used
+ */
+void idle_report(void)
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  usage.ru_utime.tv_sec += usage.ru_stime.tv_sec;
+  usage.ru_utime.tv_usec += usage.ru_stime.tv_usec;
+  if (usage.ru_utime.tv_usec >= 1000000L)
+    {
+      usage.ru_utime.tv_sec += 1;
+      usage.ru_utime.tv_usec -= 1000000L;
+    }
+  fprintf(stderr, "total-lockdown: idle watcher woke up %lu times, using %li.%06lis of CPU time\n",
+	  wakeups, (long)(usage.ru_utime.tv_sec), (long)(usage.ru_utime.tv_usec));
+}
+#endif
@@ -0,0 +1,55 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_IDLE_H
+#define TOTAL_LOCKDOWN_IDLE_H
+
+
+
+/**
+ * Open the input devices, this must be done before
+ * privileges are dropped
+ * 
+ * @return  Zero on success, -1 on error
+ */
+int idle_open(void);
+
+
+/**
+ * Wait until no input has been made for a period of time
+ * 
+ * No input device is polled, the watcher only wakes up when
+ * the period could have expired, and then checks the time
+ * of the latest input event, so while the user is active it
+ * wakes up at most once per period
+ * 
+ * @param   seconds  The period of time
+ * @return           Zero on success, -1 on error
+ */
+int idle_wait(unsigned int seconds);
+
+
+/**
+ * Print the number of times the watcher has woken up
+ * and how much CPU time the process has used, only
+ * available when compiled with -DEBUG
+ */
+void idle_report(void);
+
+
+#endif
+
@@ -0,0 +1,383 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include <inttypes.h>
+#include <linux/kd.h>
+#include <linux/keyboard.h>
+
+#include "kbddecoder.h"
+
+
+
+/* from keyboard.c */
+
+/**
+ * Symbol map, `NULL` is used if the key does not produce any
+ * symbol or (in the case of KT_LATIN, KT_LETTER, KT_META) if
+ * the output can be calcuated from the key value.
+ */
+extern const char* KVAL_MAP[][256];
+
+/**
+ * Fallback compose map that is used then the keyboard layout does not
+ * specify the common compositions. In the Linux kernel keyboard compose
+ * key and dead key are similarly to each other. The only actual difference
+ * is compose key turns the next key into a dead key. Each entry is a
+ * 3–tuple (struct kbdiacr), where the first symbol is the diacritical,
+ * the second is the base character, i.e. in the order they are typed, and
+ * the third is the resulting symbol. The resulting symbol is not in ASCII
+ * is it most not be specified with a character literal, rather its Unicode
+ * index should be specified with a numerical literal.
+ */
+extern struct kbdiacr fallback_accent_table[];
+
+
+
+/**
+ * Check whether a keymap entry is a typed keysym, rather than
+ * a Unicode code point, which `loadkeys` uses for symbols that
+ * are not in Latin-1 and the kernel returns for Unicode consoles
+ * 
+ * @param   sym  The keymap entry
+ * @return       Whether `KTYP` and `KVAL` apply to the entry
+ */
+#define IS_TYPED(sym)  ((sym) >= 0xF000)
+
+
+
+/**
+ * Append a text to the output buffer
+ * 
+ * @param   output  The output buffer
+ * @param   str     The text to append
+ * @param   n       The length of `str`
+ * @return          Zero on success, -1 if the text does not fit
+ */
+static int putstr(struct kbdoutput* output, const char* str, size_t n)
+{
+  if (output->size - output->length < n)
+    return -1;
+  memcpy(output->buffer + output->length, str, n);
+  output->length += n;
+  return 0;
+}
+
+
+/**
+ * Append a single character in UTF-8 to the output buffer
+ * 
+ * @param   output  The output buffer
+ * @param   c       The character
+ * @return          Zero on success, -1 if the character does not fit
+ */
+static int putucs(struct kbdoutput* output, int32_t c)
+{
+  char ucs_buffer[7];
+  if (c <= 0)
+    return 0; /* cannot, if it does, ignore it */
+  else if (c < 0x80)
+    {
+      ucs_buffer[6] = (char)c;
+      return putstr(output, ucs_buffer + 6, 1);
+    }
+  else
+    {
+      long off = 7;
+      *ucs_buffer = (int8_t)0x80;
+      while (c)
+	{
+	  *(ucs_buffer + --off) = (char)((c & 0x3F) | 0x80);
+	  *ucs_buffer |= (*ucs_buffer) >> 1;
+	  c >>= 6;
+	}
+      if ((*ucs_buffer) & (*(ucs_buffer + off) & 0x3F))
+	*(ucs_buffer + --off) = (char)((*ucs_buffer) << 1);
+      else
+	*(ucs_buffer + off) |= (char)((*ucs_buffer) << 1);
+      return putstr(output, ucs_buffer + off, (size_t)(7 - off));
+    }
+}
+
+
+/**
+ * Initialise a keyboard decoder
+ * 
+ * @param  decoder  The decoder
+ * @param  layout   The keyboard layout to use
+ */
+void kbddecoder_initialise(struct kbddecoder* decoder, const struct kbdlayout* layout)
+{
+  decoder->layout = layout;
+  decoder->next_is_dead2 = 0;
+  decoder->have_dead_key = 0;
+  decoder->modifiers = 0;
+  decoder->layouts = NULL;
+  decoder->layout_count = 0;
+  decoder->layout_index = 0;
+  decoder->toggle = 0;
+}
+
+
+/**
+ * Let a keyboard decoder toggle between several layouts,
+ * the layouts are not copied and must outlive the decoder
+ * 
+ * @param  decoder  The decoder
+ * @param  layouts  The layouts, in toggle order
+ * @param  count    The number of elements in `layouts`, at least 1
+ * @param  index    The index of the layout to start with
+ * @param  toggle   The modifier mask, such as `(1 << KG_SHIFT) | (1 << KG_ALTGR)`,
+ *                  that switches to the next layout when pressed, zero for none
+ */
+void kbddecoder_layouts(struct kbddecoder* decoder, const struct kbdlayout* const* layouts,
+			size_t count, size_t index, int toggle)
+{
+  decoder->layouts = layouts;
+  decoder->layout_count = count;
+  decoder->layout_index = index < count ? index : 0;
+  decoder->layout = layouts[decoder->layout_index];
+  decoder->toggle = toggle;
+}
+
+
+/**
+ * Decode a symbol, taking pending dead keys into account
+ * 
+ * @param   decoder  The decoder
+ * @param   c        The symbol's Unicode code point
+ * @param   output   The output buffer
+ * @return           Zero, or -1 if the output did not fit
+ */
+static int letter(struct kbddecoder* decoder, int c, struct kbdoutput* output)
+{
+  if (decoder->next_is_dead2)
+    {
+      decoder->next_is_dead2 = 0;
+      decoder->have_dead_key = c;
+    }
+  else if (decoder->have_dead_key) /* TODO: how does multiple dead keys work? */
+    {
+      const struct kbdiacr* accent_table = decoder->layout->accent_table;
+      unsigned int accent_table_size = *(decoder->layout->accent_table_size);
+      int have_dead_key = decoder->have_dead_key;
+      unsigned int i;
+      for (i = 0; i < accent_table_size; i++)
+	if (accent_table[i].diacr == have_dead_key)
+	  if (accent_table[i].base == c)
+	    {
+	      c = accent_table[i].result;
+	      break;
+	    }
+      if (i == accent_table_size)
+	{
+	  for (i = 0; fallback_accent_table[i].result; i++)
+	    if (fallback_accent_table[i].diacr == have_dead_key)
+	      if (fallback_accent_table[i].base == c)
+		{
+		  c = fallback_accent_table[i].result;
+		  break;
+		}
+	  if (fallback_accent_table[i].result == 0)
+	    {
+	      if (c == ' ')
+		c = have_dead_key;
+	      else if (c != have_dead_key)
+		if (putucs(output, have_dead_key))
+		  return -1;
+	    }
+	}
+      decoder->have_dead_key = 0;
+      return putucs(output, c);
+    }
+  else
+    return putucs(output, c);
+  return 0;
+}
+
+
+/**
+ * Decode one scancode
+ * 
+ * @param   decoder  The decoder
+ * @param   c        The scancode
+ * @param   output   The output buffer
+ * @return           `KBDDECODER_LINE`, `KBDDECODER_BLOCKED` or
+ *                   `KBDDECODER_LAYOUT`, or
+ *                   -1 if the output did not fit, in which case the
+ *                   decoder and the output buffer are left inconsistent
+ */
+static int decode(struct kbddecoder* decoder, int c, struct kbdoutput* output)
+{
+  unsigned short* const* key_maps = decoder->layout->key_maps;
+  char* const* func_table = decoder->layout->func_table;
+  int released = !!(c & 0x80);
+  unsigned short sym;
+  
+  c &= 0x7F;
+  sym = key_maps[0][c];
+  if (IS_TYPED(sym) && ((KTYP(sym) & 0x0F) == KT_SHIFT))
+    {
+      int toggle = decoder->toggle;
+      int before = decoder->modifiers;
+      c = sym;
+      if (released)
+	decoder->modifiers &= ~(1 << KVAL(c));
+      else
+	decoder->modifiers |= 1 << KVAL(c);
+      
+      /* switching is just a pointer swap, the chord fires once when it is completed */
+      if (toggle && ((decoder->modifiers & toggle) == toggle) && ((before & toggle) != toggle))
+	if (decoder->layout_count > 1)
+	  {
+	    if (++(decoder->layout_index) == decoder->layout_count)
+	      decoder->layout_index = 0;
+	    decoder->layout = decoder->layouts[decoder->layout_index];
+	    return KBDDECODER_LAYOUT;
+	  }
+      return 0;
+    }
+  
+  /* only the modifiers care about releases */
+  if (released || (key_maps[decoder->modifiers] == NULL))
+    return 0;
+  sym = key_maps[decoder->modifiers][c];
+  if (!IS_TYPED(sym))
+    return letter(decoder, sym, output);
+  c = sym & 0x0FFF;
+  
+  switch (KTYP(c)) /* Please fix or report any inconsistency with the Linux VT keyboard. */
+    {
+    case KT_LETTER: /* Symbols that are affected by the Royal Canterlot Voice key */
+    case KT_LATIN:  /* Symbols that are not affected by the Royal Canterlot Voice key */
+      return letter(decoder, KVAL(c) & 255, output);
+    
+    case KT_META:   /* Just like KT_LATIN, except with meta modifier */
+      if (putucs(output, '\033')) /* We will assume this mode rather than set 8:th bit-mode */
+	return -1;
+      return putucs(output, KVAL(c) & 255);
+      /* TODO how should `next_is_dead2` and `have_dead_key` behave here? */
+    
+    case KT_FN:     /* Customisable keys, usally for escape sequnces. Includes F-keys and some misc. keys */
+      if (func_table[KVAL(c)] != NULL)
+	return putstr(output, func_table[KVAL(c)], strlen(func_table[KVAL(c)]));
+      break;
+    
+    case KT_DEAD:   /* Dead key */
+      decoder->next_is_dead2 = 0;
+      if (KVAL_MAP[KTYP(c)][KVAL(c)] != NULL)
+	decoder->have_dead_key = *(KVAL_MAP[KTYP(c)][KVAL(c)]) & 255;
+      break;
+    
+    case KT_DEAD2:  /* Table-assisted customisable dead keys */
+      decoder->next_is_dead2 = 0;
+      decoder->have_dead_key = KVAL(c);
+      break;
+    
+    case KT_SPEC:   /* Special keys*/
+    case KT_PAD:    /* Keypad */
+    case KT_CUR:    /* Arrows keys */
+    case KT_ASCII:  /* This is what happens when somepony holds down Alternative whil using the keypad */
+      if (KVAL_MAP[KTYP(c)][KVAL(c)] != NULL)
+	{
+	  const char* str = KVAL_MAP[KTYP(c)][KVAL(c)];
+	  if (putstr(output, str, strlen(str)))
+	    return -1;
+	  if (!strcmp(str, "\n"))
+	    return KBDDECODER_LINE;
+	}
+      else if (KTYP(c) == KT_SPEC)
+	switch (c)
+	  {
+	  case K_COMPOSE:     /* Compose key */
+	    decoder->next_is_dead2 = 1;
+	    break;
+	  
+	  case K_NUM:         /* TODO: Num Lock */
+	  case K_BARENUMLOCK: /* No difference as far as this program is consired.
+			       * (See linux-howtos/Keyboard-and-Console-HOWTO for more information.)  */
+	    break;
+	  
+	  case K_CONS:         /* Somepony is trying to escape. Fat chance! */
+	  case K_BOOT:
+	  case K_SAK:
+	  case K_DECRCONSOLE:
+	  case K_INCRCONSOLE:
+	  case K_SPAWNCONSOLE:
+	    return KBDDECODER_BLOCKED;
+	  
+	  default: /* Other keys do nothing */
+	    break;
+	  }
+      break;
+    
+    case KT_CONS:   /* Somepony is trying to switch VT. Fat chance! */
+      return KBDDECODER_BLOCKED;
+    
+    case KT_SHIFT:  /* A modifier is used, we took care about this before the switch, so this should not happen */
+    case KT_LOCK:   /* TODO: Is this sticky keys that toggle? */
+    case KT_SLOCK:  /* TODO: Is this sticky keys that resemble dead keys? */
+    case KT_BRL:    /* TODO: Braille, how does this work? */
+    default:        /* What?! This should not happen! */
+      break;
+    }
+  
+  return 0;
+}
+
+
+/**
+ * Decode a batch of medium raw scancodes, stop after the first
+ * completed line, when the layout is switched or when the output
+ * buffer is full
+ * 
+ * This function does not allocate any memory and does not
+ * perform any I/O
+ * 
+ * @param   decoder    The decoder
+ * @param   scancodes  The scancodes to decode
+ * @param   n          The number of scancodes in `scancodes`
+ * @param   output     The output buffer
+ * @return             The number of consumed scancodes
+ */
+size_t kbddecoder_decode(struct kbddecoder* decoder, const uint8_t* scancodes,
+			 size_t n, struct kbdoutput* output)
+{
+  size_t i;
+  output->events = 0;
+  for (i = 0; i < n; i++)
+    {
+      struct kbddecoder saved_decoder = *decoder;
+      size_t saved_length = output->length;
+      int events = decode(decoder, scancodes[i], output);
+      if (events < 0)
+	{
+	  /* roll back the partial output and state of the scancode */
+	  *decoder = saved_decoder;
+	  output->length = saved_length;
+	  if (saved_length == 0)
+	    continue; /* it will never fit, drop it */
+	  output->events |= KBDDECODER_FULL;
+	  return i;
+	}
+      output->events |= events;
+      if (events & (KBDDECODER_LINE | KBDDECODER_LAYOUT))
+	return i + 1;
+    }
+  return n;
+}
+
@@ -0,0 +1,224 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_KBDDECODER_H
+#define TOTAL_LOCKDOWN_KBDDECODER_H
+
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <linux/kd.h>
+
+
+
+/**
+ * A complete line has been decoded, the newline is the
+ * last byte in the output buffer
+ */
+#define KBDDECODER_LINE  1
+
+/**
+ * The output buffer is full, flush it and call again
+ * with the scancodes that were not consumed
+ */
+#define KBDDECODER_FULL  2
+
+/**
+ * A key that would switch VT, spawn a console, reboot
+ * or invoke the secure attention key was pressed and ignored
+ */
+#define KBDDECODER_BLOCKED  4
+
+/**
+ * The layout toggle chord was pressed and the decoder
+ * switched to the next layout
+ */
+#define KBDDECODER_LAYOUT  8
+
+
+/**
+ * The smallest output buffer that is guaranteed to fit the
+ * output of any single scancode, except unusually long
+ * function key strings, which are dropped if they do not
+ * fit in an empty buffer
+ */
+#define KBDDECODER_OUTPUT_MIN  64
+
+
+
+/**
+ * A keyboard layout, as generated by `loadkeys -C TTY -m LAYOUT`
+ */
+struct kbdlayout
+{
+  /**
+   * Keymaps indexed by modifier mask, `NULL` for unused maps
+   */
+  unsigned short* const* key_maps;
+  
+  /**
+   * Strings for the function keys, `NULL` for unassigned keys
+   */
+  char* const* func_table;
+  
+  /**
+   * The layout's dead key and compose compositions
+   */
+  const struct kbdiacr* accent_table;
+  
+  /**
+   * The number of used entries in `accent_table`
+   */
+  const unsigned int* accent_table_size;
+  
+  /**
+   * Short name of the layout, for display, `NULL` if unknown
+   */
+  const char* name;
+};
+
+
+/**
+ * Keyboard decoder state, it does not own any memory,
+ * and can be copied freely
+ */
+struct kbddecoder
+{
+  /**
+   * The layout to decode with
+   */
+  const struct kbdlayout* layout;
+  
+  /**
+   * Whether the compose key was pressed and the next key
+   * is the diacritical
+   */
+  int next_is_dead2;
+  
+  /**
+   * The pending diacritical, zero if none
+   */
+  int have_dead_key;
+  
+  /**
+   * The currently held modifiers
+   */
+  int modifiers;
+  
+  /**
+   * The layouts that can be toggled between, `NULL` if
+   * only `layout` is used
+   */
+  const struct kbdlayout* const* layouts;
+  
+  /**
+   * The number of elements in `layouts`
+   */
+  size_t layout_count;
+  
+  /**
+   * The index of `layout` in `layouts`
+   */
+  size_t layout_index;
+  
+  /**
+   * The modifier mask that switches to the next layout
+   * when all of its modifiers are held, zero if none
+   */
+  int toggle;
+};
+
+
+/**
+ * Output buffer for the decoder, supplied by the caller
+ */
+struct kbdoutput
+{
+  /**
+   * The buffer, UTF-8 text is written to it
+   */
+  char* buffer;
+  
+  /**
+   * The allocation size of `buffer`
+   */
+  size_t size;
+  
+  /**
+   * The number of used bytes in `buffer`, the decoder appends
+   * to it, so the caller should reset it after flushing
+   */
+  size_t length;
+  
+  /**
+   * Bitwise or of `KBDDECODER_LINE`, `KBDDECODER_FULL`,
+   * `KBDDECODER_BLOCKED` and `KBDDECODER_LAYOUT` for the
+   * last call, reset by the decoder
+   */
+  int events;
+};
+
+
+
+/**
+ * The layout the program was built with, from src/layout.c
+ */
+extern const struct kbdlayout kbdlayout_default;
+
+
+/**
+ * Initialise a keyboard decoder
+ * 
+ * @param  decoder  The decoder
+ * @param  layout   The keyboard layout to use
+ */
+void kbddecoder_initialise(struct kbddecoder* decoder, const struct kbdlayout* layout);
+
+/**
+ * Let a keyboard decoder toggle between several layouts,
+ * the layouts are not copied and must outlive the decoder
+ * 
+ * @param  decoder  The decoder
+ * @param  layouts  The layouts, in toggle order
+ * @param  count    The number of elements in `layouts`, at least 1
+ * @param  index    The index of the layout to start with
+ * @param  toggle   The modifier mask, such as `(1 << KG_SHIFT) | (1 << KG_ALTGR)`,
+ *                  that switches to the next layout when pressed, zero for none
+ */
+void kbddecoder_layouts(struct kbddecoder* decoder, const struct kbdlayout* const* layouts,
+			size_t count, size_t index, int toggle);
+
+/**
+ * Decode a batch of medium raw scancodes, stop after the first
+ * completed line, when the layout is switched or when the output
+ * buffer is full
+ * 
+ * This function does not allocate any memory and does not
+ * perform any I/O
+ * 
+ * @param   decoder    The decoder
+ * @param   scancodes  The scancodes to decode
+ * @param   n          The number of scancodes in `scancodes`
+ * @param   output     The output buffer
+ * @return             The number of consumed scancodes
+ */
+size_t kbddecoder_decode(struct kbddecoder* decoder, const uint8_t* scancodes,
+			 size_t n, struct kbdoutput* output);
+
+
+#endif
+
@@ -15,47 +15,70 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <inttypes.h>
-#include <stdlib.h>
-#include <linux/kd.h>
+#include <errno.h>
+#include <sys/mman.h>
 #include <linux/keyboard.h>
-#include <stdio.h>
 
 #include "kbddriver.h"
+#include "kbddecoder.h"
+#include "platform.h"
+
 
 
-# pragma GCC diagnostic push
-# pragma GCC diagnostic ignored "-pedantic"
-#include "layout.c" /* When building, the user must do `loadkeys -C THE_USED_TTY -m THE_PREFERED_LAYOUT > src/layout.c`.
-		     * It may be possible to look for the first /dev/tty* owned by $USER and get the keyboard from KEYMAP
-		     * in rc.conf or vconsole.conf. */
-# pragma GCC diagnostic pop
+/**
+ * The modifiers that, when held together, switch to the next layout
+ */
+#ifndef LAYOUT_TOGGLE
+# define LAYOUT_TOGGLE  ((1 << KG_SHIFT) | (1 << KG_ALTGR))
+#endif
 
+/**
+ * The maximum number of resident layouts
+ */
+#define MAX_LAYOUTS  8
 
 
-/* from keyboard.c */
 
 /**
- * Symbol map, `NULL` is used if the key does not produce any
- * symbol or (in the case of KT_LATIN, KT_LETTER, KT_META) if
- * the output can be calcuated from the key value.
+ * The resident layouts, in toggle order
  */
-extern const char* KVAL_MAP[][256];
+static const struct kbdlayout* layouts[MAX_LAYOUTS];
 
 /**
- * Fallback compose map that is used then the keyboard layout does not
- * specify the common compositions. In the Linux kernel keyboard compose
- * key and dead key are similarly to each other. The only actual difference
- * is compose key turns the next key into a dead key. Each entry is a
- * 3–tuple (struct kbdiacr), where the first symbol is the diacritical,
- * the second is the base character, i.e. in the order they are typed, and
- * the third is the resulting symbol. The resulting symbol is not in ASCII
- * is it most not be specified with a character literal, rather its Unicode
- * index should be specified with a numerical literal.
+ * The number of used elements in `layouts`, zero if only
+ * the built-in layout is used
  */
-extern struct kbdiacr fallback_accent_table[];
+static size_t layout_count = 0;
+
+/**
+ * The index of the selected layout, it is shared between
+ * the attempts so that the selection survives failures
+ */
+static volatile size_t* selected_layout = NULL;
+
+/**
+ * The decoder for `readkbd`, its layout is `NULL` until it is used
+ */
+static struct kbddecoder decoder = { .layout = NULL };
+
+/**
+ * Scancodes that have been read but not decoded
+ */
+static uint8_t input[64];
+
+/**
+ * The position of the next scancode to decode in `input`
+ */
+static size_t input_ptr = 0;
+
+/**
+ * The number of used bytes in `input`
+ */
+static size_t input_end = 0;
 
 
 
@@ -64,10 +87,10 @@ extern struct kbdiacr fallback_accent_table[];
  * 
  * @param  fd   The file descriptor
  * @param  str  The text to write
+ * @param  n    The length of the text
  */
-static void fdprint(int fd, const char* str)
+static void fdprint(int fd, const char* str, size_t n)
 {
-  size_t n = strlen(str);
   ssize_t wrote;
   while (n)
     {
@@ -81,171 +104,212 @@ static void fdprint(int fd, const char* str)
 
 
 /**
- * Print a single character in UTF-8 to a file by its descriptor
+ * Check whether two layouts produce the same keysyms
  * 
- * @param  fd  The file descriptor
- * @param  c   The character
+ * @param   a  One of the layouts
+ * @param   b  The other layout
+ * @return     Whether the layouts' keymaps are identical
  */
-static void fdputucs(int fd, int32_t c)
+static int __attribute__((pure)) same_keys(const struct kbdlayout* a, const struct kbdlayout* b)
 {
-  static char ucs_buffer[8] = {[7] = 0};
-  if (c < 0)
-    ; /* cannot, if it does, ignore it */
-  else if (c < 0x80)
+  int table, index;
+  for (table = 0; table < MAX_NR_KEYMAPS; table++)
     {
-      ucs_buffer[6] = (char)c;
-      fdprint(fd, ucs_buffer + 6);
+      if ((a->key_maps[table] == NULL) || (b->key_maps[table] == NULL))
+	{
+	  if (a->key_maps[table] != b->key_maps[table])
+	    return 0;
+	  continue;
+	}
+      for (index = 0; index < NR_KEYS; index++)
+	if (a->key_maps[table][index] != b->key_maps[table][index])
+	  return 0;
     }
+  return 1;
+}
+
+
+/**
+ * Print the prompt on the current line, with the
+ * selected layout if there are several
+ * 
+ * @param  prompt  The prompt
+ * @param  layout  The selected layout, `NULL` to omit it
+ */
+static void print_prompt(const char* prompt, const struct kbdlayout* layout)
+{
+  char buffer[512];
+  if ((layout != NULL) && (layout_count > 1) && (layout->name != NULL))
+    snprintf(buffer, sizeof(buffer), "\r\033[K    [%s] %s", layout->name, prompt);
   else
+    snprintf(buffer, sizeof(buffer), "\r\033[K    %s", prompt);
+  platform->print(buffer);
+}
+
+
+/**
+ * Select the layouts that `readkbd` can toggle between, layouts
+ * with the same keymaps as an earlier layout are skipped
+ * 
+ * This must be called before the attempts are started, and
+ * the layouts must outlive them, the first layout is selected
+ * 
+ * @param   list   The layouts, in toggle order
+ * @param   count  The number of elements in `list`
+ * @return         Zero on success, -1 on error
+ */
+int kbddriver_layouts(const struct kbdlayout* const* list, size_t count)
+{
+  size_t i, j;
+  void* mem;
+  
+  layout_count = 0;
+  if (selected_layout == NULL)
     {
-      long off = 7;
-      *ucs_buffer = (int8_t)0x80;
-      while (c)
-	{
-	  *(ucs_buffer + --off) = (char)((c & 0x3F) | 0x80);
-	  *ucs_buffer |= (*ucs_buffer) >> 1;
-	  c >>= 6;
-	}
-      if ((*ucs_buffer) & (*(ucs_buffer + off) & 0x3F))
-	*(ucs_buffer + --off) = (char)((*ucs_buffer) << 1);
-      else
-	*(ucs_buffer + off) |= (char)((*ucs_buffer) << 1);
-      fdprint(fd, ucs_buffer + off);
+      mem = mmap(NULL, sizeof(size_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+      if (mem == MAP_FAILED)
+	return -1;
+      selected_layout = mem;
+    }
+  
+  for (i = 0; (i < count) && (layout_count < MAX_LAYOUTS); i++)
+    {
+      for (j = 0; j < layout_count; j++)
+	if (same_keys(list[i], layouts[j]))
+	  break;
+      if (j == layout_count)
+	layouts[layout_count++] = list[i];
     }
+  *selected_layout = 0;
+  return 0;
+}
+
+
+/**
+ * Forget any keyboard state from earlier lines, held modifiers,
+ * pending dead keys and scancodes that have not been decoded,
+ * the selected layout is kept
+ */
+void kbddriver_reset(void)
+{
+  decoder.layout = NULL;
+  explicit_bzero(input, sizeof(input));
+  input_ptr = input_end = 0;
 }
 
 
 /**
  * Read one line from the keyboard
  * 
- * @param  fd  File descriptor for the sink
+ * @param   fd      File descriptor for the sink
+ * @param   prompt  The prompt to print
+ * @return          Zero on success, -1 if the keyboard was lost
  */
-void readkbd(int fd)
+int readkbd(int fd, const char* prompt)
 {
-  static int next_is_dead2 = 0;
-  static int have_dead_key = 0;
-  static int modifiers = 0;
+  char buffer[KBDDECODER_OUTPUT_MIN * 4];
+  struct kbdoutput output = { .buffer = buffer, .size = sizeof(buffer), .length = 0, .events = 0 };
+  int rc = -1;
   
-  for (;;) /* Please fix or report any inconsistency with the Linux VT keyboard. */
+  if (decoder.layout == NULL)
     {
-      int c = getchar();
-      int released = !!(c & 0x80);
-      
-      if ((KTYP(key_maps[0][c & 0x7F]) & 0x0F) == KT_SHIFT)
+      kbddecoder_initialise(&decoder, &kbdlayout_default);
+      if (layout_count > 0)
+	kbddecoder_layouts(&decoder, layouts, layout_count, *selected_layout, LAYOUT_TOGGLE);
+    }
+  print_prompt(prompt, decoder.layout);
+  
+  for (;;)
+    {
+      if (input_ptr == input_end)
 	{
-	  c = key_maps[0][c & 0x7F];
-	  if (released)
-	    modifiers &= ~(1 << KVAL(c));
-	  else
-	    modifiers |= 1 << KVAL(c);
-	  continue;
+	  ssize_t got = platform->read(STDIN_FILENO, input, sizeof(input));
+	  if (got <= 0)
+	    {
+	      if ((got < 0) && (errno == EINTR))
+		continue;
+	      break;
+	    }
+	  input_ptr = 0;
+	  input_end = (size_t)got;
 	}
       
-      if (key_maps[modifiers] == NULL)
-	continue;
-      c = key_maps[modifiers][c] & 0x0FFF;
+      /* the verifier needs the whole line anyway, so we only write
+       * once it is complete, keystrokes only cost the read */
+      input_ptr += kbddecoder_decode(&decoder, input + input_ptr, input_end - input_ptr, &output);
+      if (output.events & (KBDDECODER_LINE | KBDDECODER_FULL))
+	{
+	  fdprint(fd, buffer, output.length);
+	  output.length = 0;
+	}
+      if (output.events & KBDDECODER_LAYOUT)
+	{
+	  *selected_layout = decoder.layout_index;
+	  print_prompt(prompt, decoder.layout);
+	}
+      if (output.events & KBDDECODER_LINE)
+	{
+	  rc = 0;
+	  break;
+	}
+    }
+  
+  explicit_bzero(buffer, sizeof(buffer)); /* wipe it! */
+  explicit_bzero(input, input_ptr);
+  return rc;
+}
+
+
+/**
+ * Read one line from the console in Unicode mode,
+ * where the kernel has already decoded the keyboard
+ * 
+ * @param   fd      File descriptor for the sink
+ * @param   prompt  The prompt to print
+ * @return          Zero on success, -1 if the keyboard was lost
+ */
+int readtty(int fd, const char* prompt)
+{
+  char buffer[64];
+  char line[KBDDECODER_OUTPUT_MIN * 4];
+  size_t i, length = 0;
+  ssize_t got;
+  int rc = -1;
+  
+  print_prompt(prompt, NULL); /* the kernel decodes with its own keymap */
+  
+  for (;;)
+    {
+      got = platform->read(STDIN_FILENO, buffer, sizeof(buffer));
+      if (got <= 0)
+	{
+	  if ((got < 0) && (errno == EINTR))
+	    continue;
+	  break;
+	}
       
-      switch (KTYP(c))
+      /* like readkbd, we only write once the line is complete */
+      for (i = 0; i < (size_t)got; i++)
 	{
-	case KT_LETTER: /* Symbols that are affected by the Royal Canterlot Voice key */
-	case KT_LATIN:  /* Symbols that are not affected by the Royal Canterlot Voice key */
-	  if (next_is_dead2)
+	  if (length == sizeof(line))
 	    {
-	      next_is_dead2 = 0;
-	      have_dead_key = KVAL(c) & 255;
+	      fdprint(fd, line, length);
+	      length = 0;
 	    }
-	  else if (have_dead_key) /* TODO: how does multiple dead keys work? */
+	  line[length++] = buffer[i];
+	  if ((buffer[i] == '\r') || (buffer[i] == '\n')) /* ICRNL is turned off, so enter is read as CR */
 	    {
-	      unsigned int i;
-	      c = KVAL(c) & 255;
-	      for (i = 0; i < accent_table_size; i++)
-		if (accent_table[i].diacr == have_dead_key)
-		  if (accent_table[i].base == c)
-		    {
-		      c = accent_table[i].result;
-		      break;
-		    }
-	      if (i == accent_table_size)
-		{
-		  for (i = 0; fallback_accent_table[i].result; i++)
-		    if (fallback_accent_table[i].diacr == have_dead_key)
-		      if (fallback_accent_table[i].base == c)
-			{
-			  c = fallback_accent_table[i].result;
-			  break;
-			}
-		  if (fallback_accent_table[i].result == 0)
-		    {
-		      if (c == ' ')
-			c = have_dead_key;
-		      else if (c != have_dead_key)
-			fdputucs(fd, have_dead_key);
-		    }
-		}
-	      fdputucs(fd, c);
-	      have_dead_key = 0;
+	      line[length - 1] = '\n';
+	      fdprint(fd, line, length);
+	      rc = 0;
+	      goto done;
 	    }
-	  else
-	    fdputucs(fd, KVAL(c) & 255);
-	  break;
-	  
-	case KT_META:   /* Just like KT_LATIN, except with meta modifier */
-	  fdputucs(fd, '\033'); /* We will assume this mode rather than set 8:th bit-mode */
-	  fdputucs(fd, KVAL(c) & 255);
-	  /* TODO how should `next_is_dead2` and `have_dead_key` behave here? */
-	  break;
-	  
-	case KT_FN:     /* Customisable keys, usally for escape sequnces. Includes F-keys and some misc. keys */
-	  if (func_table[KVAL(c)] != NULL)
-	    fdprint(fd, func_table[KVAL(c)]);
-	  break;
-	  
-	case KT_DEAD:   /* Dead key */
-	  next_is_dead2 = 0;
-	  have_dead_key = *(KVAL_MAP[KTYP(c)][KVAL(c)]) & 255;
-	  break;
-	  
-	case KT_DEAD2:  /* Table-assisted customisable dead keys */
-	  next_is_dead2 = 0;
-	  have_dead_key = KVAL(c);
-	  break;
-	  
-	case KT_SPEC:   /* Special keys*/
-	case KT_PAD:    /* Keypad */
-	case KT_CUR:    /* Arrows keys */
-	case KT_ASCII:  /* This is what happens when somepony holds down Alternative whil using the keypad */
-	  if (KVAL_MAP[KTYP(c)][KVAL(c)] != NULL)
-	    {
-	      const char* str = KVAL_MAP[KTYP(c)][KVAL(c)];
-	      fdprint(fd, str);
-	      if (!strcmp(str, "\n"))
-		return;
-	    }
-	  else if (KTYP(c) == KT_SPEC)
-	    switch (c)
-	      {
-	      case K_COMPOSE:     /* Compose key */
-		next_is_dead2 = 1;
-		break;
-		
-	      case K_NUM:         /* TODO: Num Lock */
-	      case K_BARENUMLOCK: /* No difference as far as this program is consired.
-				   * (See linux-howtos/Keyboard-and-Console-HOWTO for more information.)  */
-		break;
-		
-	      default: /* Other keys do nothing */
-		break;
-	      }
-	  break;
-	  
-	case KT_SHIFT:  /* A modifier is used, we took care about this before the switch, so this should not happen */
-	case KT_CONS:   /* Somepony is trying to switch VT. Fat chance! */
-	case KT_LOCK:   /* TODO: Is this sticky keys that toggle? */
-	case KT_SLOCK:  /* TODO: Is this sticky keys that resemble dead keys? */
-	case KT_BRL:    /* TODO: Braille, how does this work? */
-	default:        /* What?! This should not happen! */
-	  break;
 	}
     }
+  
+ done:
+  explicit_bzero(buffer, sizeof(buffer)); /* wipe it! */
+  explicit_bzero(line, sizeof(line));
+  return rc;
 }
 
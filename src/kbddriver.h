@@ -19,12 +19,50 @@
 #define TOTAL_LOCKDOWN_KBDDRIVER_H
 
 
+#include <stddef.h>
+
+#include "kbddecoder.h"
+
+
+
+/**
+ * Select the layouts that `readkbd` can toggle between, layouts
+ * with the same keymaps as an earlier layout are skipped
+ * 
+ * This must be called before the attempts are started, and
+ * the layouts must outlive them, the first layout is selected
+ * 
+ * @param   list   The layouts, in toggle order
+ * @param   count  The number of elements in `list`
+ * @return         Zero on success, -1 on error
+ */
+int kbddriver_layouts(const struct kbdlayout* const* list, size_t count);
+
+/**
+ * Forget any keyboard state from earlier lines, held modifiers,
+ * pending dead keys and scancodes that have not been decoded,
+ * the selected layout is kept
+ */
+void kbddriver_reset(void);
+
 /**
  * Read one line from the keyboard
  * 
- * @param  fd  File descriptor for the sink
+ * @param   fd      File descriptor for the sink
+ * @param   prompt  The prompt to print
+ * @return          Zero on success, -1 if the keyboard was lost
+ */
+int readkbd(int fd, const char* prompt);
+
+/**
+ * Read one line from the console in Unicode mode,
+ * where the kernel has already decoded the keyboard
+ * 
+ * @param   fd      File descriptor for the sink
+ * @param   prompt  The prompt to print
+ * @return          Zero on success, -1 if the keyboard was lost
  */
-void readkbd(int fd);
+int readtty(int fd, const char* prompt);
 
 
 #endif
@@ -0,0 +1,53 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <linux/kd.h>
+#include <linux/keyboard.h>
+
+#include "kbddecoder.h"
+
+
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-pedantic"
+#include "layout.c" /* When building, the user must do `loadkeys -C THE_USED_TTY -m THE_PREFERED_LAYOUT > src/layout.c`.
+		     * It may be possible to look for the first /dev/tty* owned by $USER and get the keyboard from KEYMAP
+		     * in rc.conf or vconsole.conf. */
+# pragma GCC diagnostic pop
+
+
+/**
+ * The name of the layout in src/layout.c, shown when several layouts are resident
+ */
+#ifndef KBDLAYOUT_NAME
+# define KBDLAYOUT_NAME  "built-in"
+#endif
+
+
+
+/**
+ * The layout the program was built with, from src/layout.c
+ */
+const struct kbdlayout kbdlayout_default =
+  {
+    .key_maps          = key_maps,
+    .func_table        = func_table,
+    .accent_table      = accent_table,
+    .accent_table_size = &accent_table_size,
+    .name              = KBDLAYOUT_NAME
+  };
+
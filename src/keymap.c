@@ -0,0 +1,450 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "keymap.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/kd.h>
+#include <linux/keyboard.h>
+
+
+
+/**
+ * The maximum number of keymap entries that can be blanked,
+ * a typical keymap has less than a hundred
+ */
+#define MAX_BLANKED  4096
+
+/**
+ * The maximum length of a layout's name, including the NUL
+ */
+#define MAX_LAYOUT_NAME  32
+
+
+
+/**
+ * A keymap entry that has been blanked
+ */
+struct blanked_entry
+{
+  /**
+   * The modifier table
+   */
+  unsigned char table;
+  
+  /**
+   * The keycode
+   */
+  unsigned char index;
+  
+  /**
+   * The original keysym
+   */
+  unsigned short value;
+};
+
+
+
+/**
+ * The fixed part of a layout loaded from the kernel, it is followed
+ * by its keymaps and then its function key strings, all in one mapping
+ */
+struct loaded_layout
+{
+  /**
+   * The layout, it is first, so that a pointer to it
+   * is a pointer to the whole mapping
+   */
+  struct kbdlayout layout;
+  
+  /**
+   * The mapping
+   */
+  void* base;
+  
+  /**
+   * The size of the mapping
+   */
+  size_t size;
+  
+  /**
+   * Pointers to the keymaps later in the mapping
+   */
+  unsigned short* key_maps[MAX_NR_KEYMAPS];
+  
+  /**
+   * Pointers to the function key strings later in the mapping
+   */
+  char* func_table[MAX_NR_FUNC];
+  
+  /**
+   * The dead key and compose compositions
+   */
+  struct kbdiacrs accents;
+  
+  /**
+   * The name of the layout
+   */
+  char name[MAX_LAYOUT_NAME];
+};
+
+
+
+/**
+ * The entries that have been blanked, in the order they were blanked
+ */
+static struct blanked_entry blanked[MAX_BLANKED];
+
+/**
+ * The number of used elements in `blanked`
+ */
+static volatile size_t blanked_count = 0;
+
+
+
+/**
+ * Check whether a keysym can be used to leave the lock
+ * 
+ * @param   value  The keysym
+ * @return         Whether the keysym is an escape hatch
+ */
+static int __attribute__((const)) is_escape(unsigned short value)
+{
+  if (KTYP(value) == KT_CONS) /* Switch to a specific VT */
+    return 1;
+  switch (value)
+    {
+    case K_CONS:          /* Switch to last VT */
+    case K_DECRCONSOLE:   /* Switch to previous VT */
+    case K_INCRCONSOLE:   /* Switch to next VT */
+    case K_SPAWNCONSOLE:  /* Spawn and switch to a new VT */
+    case K_SAK:           /* Secure attention key, kills everything on the VT */
+    case K_BOOT:          /* Three finger salute */
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+
+/**
+ * Read a keymap entry
+ * 
+ * @param   fd     File descriptor for the console
+ * @param   table  The modifier table
+ * @param   index  The keycode
+ * @param   value  Output parameter for the keysym
+ * @return         Zero on success, -1 on error
+ */
+static int get_entry(int fd, int table, int index, unsigned short* value)
+{
+  struct kbentry entry;
+  entry.kb_table = (unsigned char)table;
+  entry.kb_index = (unsigned char)index;
+  entry.kb_value = 0;
+  if (ioctl(fd, KDGKBENT, &entry))
+    return -1;
+  *value = entry.kb_value;
+  return 0;
+}
+
+
+/**
+ * Write a keymap entry
+ * 
+ * @param   fd     File descriptor for the console
+ * @param   table  The modifier table
+ * @param   index  The keycode
+ * @param   value  The keysym
+ * @return         Zero on success, -1 on error
+ */
+static int set_entry(int fd, int table, int index, unsigned short value)
+{
+  struct kbentry entry;
+  entry.kb_table = (unsigned char)table;
+  entry.kb_index = (unsigned char)index;
+  entry.kb_value = value;
+  return ioctl(fd, KDSKBENT, &entry) ? -1 : 0;
+}
+
+
+/**
+ * Install a restricted copy of the kernel keymap, where every key
+ * that switches VT, spawns a console, reboots or invokes the secure
+ * attention key is blanked, and remember the original entries
+ * 
+ * The kernel keymap is shared by all VTs, so it must be restored
+ * with `keymap_restore` no matter how the lock ends
+ * 
+ * @param   fd  File descriptor for the console
+ * @return      Zero on success, -1 on error, in which case
+ *              the original keymap has been restored
+ */
+int keymap_restrict(int fd)
+{
+  unsigned short value;
+  int table, index, saved_errno;
+  
+  for (table = 0; table < MAX_NR_KEYMAPS; table++)
+    {
+      if (get_entry(fd, table, 0, &value))
+	goto fail;
+      if (value == K_NOSUCHMAP) /* the table is not allocated */
+	continue;
+      
+      for (index = 0; index < NR_KEYS; index++)
+	{
+	  if (get_entry(fd, table, index, &value))
+	    goto fail;
+	  if (!is_escape(value))
+	    continue;
+	  
+	  if (blanked_count == MAX_BLANKED)
+	    {
+	      errno = ENOMEM;
+	      goto fail;
+	    }
+	  
+	  /* record it before blanking it, so a signal can restore it */
+	  blanked[blanked_count].table = (unsigned char)table;
+	  blanked[blanked_count].index = (unsigned char)index;
+	  blanked[blanked_count].value = value;
+	  blanked_count++;
+	  
+	  if (set_entry(fd, table, index, K_HOLE))
+	    goto fail;
+	}
+    }
+  
+  return 0;
+  
+ fail:
+  saved_errno = errno;
+  keymap_restore(fd);
+  errno = saved_errno;
+  return -1;
+}
+
+
+/**
+ * Check that the installed kernel keymap does not contain any
+ * key that could be used to escape the lock
+ * 
+ * @param   fd  File descriptor for the console
+ * @return      The number of escape hatches, -1 on error
+ */
+int keymap_audit(int fd)
+{
+  unsigned short value;
+  int table, index, hatches = 0;
+  
+  for (table = 0; table < MAX_NR_KEYMAPS; table++)
+    {
+      if (get_entry(fd, table, 0, &value))
+	return -1;
+      if (value == K_NOSUCHMAP)
+	continue;
+      for (index = 0; index < NR_KEYS; index++)
+	{
+	  if (get_entry(fd, table, index, &value))
+	    return -1;
+	  hatches += is_escape(value);
+	}
+    }
+  
+  return hatches;
+}
+
+
+/**
+ * Restore the original kernel keymap, this function is
+ * async-signal-safe and does nothing if the keymap is
+ * not restricted
+ * 
+ * @param  fd  File descriptor for the console
+ */
+void keymap_restore(int fd)
+{
+  while (blanked_count)
+    {
+      struct blanked_entry* entry = blanked + blanked_count - 1;
+      set_entry(fd, entry->table, entry->index, entry->value);
+      blanked_count--;
+    }
+}
+
+
+/**
+ * Get the keymap name from a console configuration file,
+ * such as /etc/vconsole.conf or /etc/rc.conf
+ * 
+ * @param   pathname  The configuration file
+ * @param   name      Output buffer for the name, `MAX_LAYOUT_NAME` bytes
+ * @return            Zero on success, -1 if not found
+ */
+static int config_keymap(const char* pathname, char* name)
+{
+  char line[256];
+  char* value;
+  size_t n;
+  FILE* f;
+  
+  if ((f = fopen(pathname, "r")) == NULL)
+    return -1;
+  
+  while (fgets(line, sizeof(line), f))
+    {
+      for (value = line; (*value == ' ') || (*value == '\t'); value++)
+	;
+      if (strncmp(value, "KEYMAP=", 7))
+	continue;
+      value += 7;
+      value += (*value == '"') || (*value == '\'');
+      if ((n = strcspn(value, "\"' \t\n#")) == 0)
+	continue;
+      if (n >= MAX_LAYOUT_NAME)
+	n = MAX_LAYOUT_NAME - 1;
+      memcpy(name, value, n);
+      name[n] = '\0';
+      fclose(f);
+      return 0;
+    }
+  
+  fclose(f);
+  return -1;
+}
+
+
+/**
+ * Load a copy of the kernel keymap, including its function key
+ * strings and compositions, into one read-only mapping, so that
+ * it can be used by the keyboard decoder
+ * 
+ * This must be done before the keymap is restricted
+ * 
+ * @param   fd  File descriptor for the console
+ * @return      The layout, `NULL` on error, it should be
+ *              released with `keymap_unload`
+ */
+const struct kbdlayout* keymap_load(int fd)
+{
+  size_t size = sizeof(struct loaded_layout) + MAX_NR_KEYMAPS * NR_KEYS * sizeof(unsigned short)
+    + MAX_NR_FUNC * sizeof(((struct kbsentry*)NULL)->kb_string);
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  struct loaded_layout* loaded;
+  struct kbsentry function;
+  unsigned short* map;
+  unsigned short value;
+  char* string;
+  size_t used, n;
+  int table, index, saved_errno;
+  void* mem;
+  
+  /* reserve for the worst case, only the pages we write to are backed */
+  size = (size + page - 1) / page * page;
+  mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+    return NULL;
+  loaded = mem;
+  map = (unsigned short*)(loaded + 1);
+  
+  for (table = 0; table < MAX_NR_KEYMAPS; table++)
+    {
+      if (get_entry(fd, table, 0, &value))
+	goto fail;
+      if (value == K_NOSUCHMAP)
+	continue; /* mapped anonymous memory is zeroed, so it is already `NULL` */
+      loaded->key_maps[table] = map;
+      for (index = 0; index < NR_KEYS; index++, map++)
+	{
+	  if (get_entry(fd, table, index, &value))
+	    goto fail;
+	  /* the representation `loadkeys -m` uses, typed keysyms get the high
+	   * nibble set, and in Unicode consoles, code points get it cleared */
+	  *map = (unsigned short)(value ^ 0xF000);
+	}
+    }
+  
+  if (loaded->key_maps[0] == NULL)
+    {
+      errno = ENOENT; /* the decoder needs the plain map for the modifiers */
+      goto fail;
+    }
+  
+  string = (char*)map;
+  for (index = 0; index < MAX_NR_FUNC; index++)
+    {
+      function.kb_func = (unsigned char)index;
+      if (ioctl(fd, KDGKBSENT, &function))
+	goto fail;
+      function.kb_string[sizeof(function.kb_string) - 1] = '\0';
+      if ((n = strlen((char*)(function.kb_string))) == 0)
+	continue;
+      loaded->func_table[index] = string;
+      memcpy(string, function.kb_string, n + 1);
+      string += n + 1;
+    }
+  
+  if (ioctl(fd, KDGKBDIACR, &(loaded->accents)))
+    goto fail;
+  
+  if (config_keymap("/etc/vconsole.conf", loaded->name) && config_keymap("/etc/rc.conf", loaded->name))
+    strcpy(loaded->name, "console");
+  
+  loaded->layout.key_maps = loaded->key_maps;
+  loaded->layout.func_table = loaded->func_table;
+  loaded->layout.accent_table = loaded->accents.kbdiacr;
+  loaded->layout.accent_table_size = &(loaded->accents.kb_cnt);
+  loaded->layout.name = loaded->name;
+  
+  /* give back what we did not need, and make the rest read-only */
+  used = (size_t)(string - (char*)mem);
+  used = (used + page - 1) / page * page;
+  if (used < size)
+    munmap((char*)mem + used, size - used);
+  loaded->base = mem;
+  loaded->size = used;
+  if (mprotect(mem, used, PROT_READ))
+    goto fail; /* unmapping the part that is already unmapped is harmless */
+  
+  return &(loaded->layout);
+  
+ fail:
+  saved_errno = errno;
+  munmap(mem, size);
+  errno = saved_errno;
+  return NULL;
+}
+
+
+/**
+ * Release a layout loaded with `keymap_load`
+ * 
+ * @param  layout  The layout, may be `NULL`
+ */
+void keymap_unload(const struct kbdlayout* layout)
+{
+  const struct loaded_layout* loaded = (const struct loaded_layout*)layout;
+  if (loaded != NULL)
+    munmap(loaded->base, loaded->size);
+}
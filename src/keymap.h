@@ -0,0 +1,84 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_KEYMAP_H
+#define TOTAL_LOCKDOWN_KEYMAP_H
+
+
+#include "kbddecoder.h"
+
+
+
+/**
+ * Install a restricted copy of the kernel keymap, where every key
+ * that switches VT, spawns a console, reboots or invokes the secure
+ * attention key is blanked, and remember the original entries
+ * 
+ * The kernel keymap is shared by all VTs, so it must be restored
+ * with `keymap_restore` no matter how the lock ends
+ * 
+ * @param   fd  File descriptor for the console
+ * @return      Zero on success, -1 on error, in which case
+ *              the original keymap has been restored
+ */
+int keymap_restrict(int fd);
+
+
+/**
+ * Check that the installed kernel keymap does not contain any
+ * key that could be used to escape the lock
+ * 
+ * @param   fd  File descriptor for the console
+ * @return      The number of escape hatches, -1 on error
+ */
+int keymap_audit(int fd);
+
+
+/**
+ * Restore the original kernel keymap, this function is
+ * async-signal-safe and does nothing if the keymap is
+ * not restricted
+ * 
+ * @param  fd  File descriptor for the console
+ */
+void keymap_restore(int fd);
+
+
+/**
+ * Load a copy of the kernel keymap, including its function key
+ * strings and compositions, into one read-only mapping, so that
+ * it can be used by the keyboard decoder
+ * 
+ * This must be done before the keymap is restricted
+ * 
+ * @param   fd  File descriptor for the console
+ * @return      The layout, `NULL` on error, it should be
+ *              released with `keymap_unload`
+ */
+const struct kbdlayout* keymap_load(int fd);
+
+
+/**
+ * Release a layout loaded with `keymap_load`
+ * 
+ * @param  layout  The layout, may be `NULL`
+ */
+void keymap_unload(const struct kbdlayout* layout);
+
+
+#endif
+
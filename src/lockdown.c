@@ -0,0 +1,450 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "lockdown.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <termios.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <linux/kd.h>
+#include <crypt.h>
+
+#include "platform.h"
+#include "audit.h"
+#include "kbddriver.h"
+
+
+#if defined(EBUG) && !defined(DEBUG)
+# define DEBUG
+#endif
+
+
+
+/**
+ * Exit status of an attempt whose passphrase was correct
+ */
+#define ATTEMPT_SUCCESS  0
+
+/**
+ * Exit status of an attempt that lost the keyboard
+ */
+#define ATTEMPT_INPUT_LOST  3
+
+/**
+ * Exit status of a guard that could not run any more attempts
+ */
+#define GUARD_FAILED  4
+
+
+
+/**
+ * The console settings for the lock
+ */
+struct checkpoint
+{
+  /**
+   * The terminal attributes to restore on unlock
+   */
+  struct termios saved_stty;
+  
+  /**
+   * The keyboard mode to restore on unlock
+   */
+  int saved_kbd_mode;
+  
+  /**
+   * The terminal attributes while locked
+   */
+  struct termios locked_stty;
+  
+  /**
+   * The keyboard mode while locked
+   */
+  int locked_kbd_mode;
+};
+
+
+/**
+ * Arguments for `guard`
+ */
+struct guardian
+{
+  /**
+   * How to lock the console
+   */
+  const struct lock* lock;
+  
+  /**
+   * The sealed console settings
+   */
+  const struct checkpoint* checkpoint;
+};
+
+
+/**
+ * Arguments for `verifier`
+ */
+struct verification
+{
+  /**
+   * The read end of the pipe the passphrase is written to
+   */
+  int fd;
+  
+  /**
+   * The write end of the pipe, it must be closed by a forked
+   * verifier, the attempt sets it to -1 once it has closed its
+   * own, which is the only one under simulation
+   */
+  int write_fd;
+  
+  /**
+   * The real user's encrypted passphrase
+   */
+  const char* encrypted;
+  
+  /**
+   * Returns the latest encrypted passphrase, or `NULL`
+   * to keep `encrypted`, may be `NULL`
+   */
+  const char* (*refresh)(void);
+};
+
+
+
+/**
+ * Read a passphrase and check it, runs in its own process
+ * 
+ * @param   arg  `struct verification*`
+ * @return       0 if the passphrase is correct, 1 if incorrect,
+ *               2 if it could not be verified
+ */
+static int verifier(const void* arg)
+{
+  const struct verification* verification = arg;
+  const char* encrypted = verification->encrypted;
+  const char* latest;
+  char* passphrase;
+  char* passphrase_crypt;
+  size_t length;
+  int revoked;
+  
+  if (verification->write_fd >= 0)
+    close(verification->write_fd);
+  passphrase = platform->readpass(verification->fd);
+  
+  /* the passphrase may have been changed while we were waiting for
+   * the line, the user will have entered the new one, so only look now */
+  if (verification->refresh && (latest = verification->refresh()))
+    encrypted = latest;
+  
+  /* crypt(3) may fail rather than mismatch on a locked account's passphrase */
+  revoked = (*encrypted == '!') || (*encrypted == '*');
+  passphrase_crypt = revoked ? NULL : crypt(passphrase, encrypted);
+  length = strlen(passphrase);
+  memset(passphrase, 0, length); /* wipe it! */
+  free(passphrase);
+  
+  if ((passphrase_crypt == NULL) && !revoked)
+    {
+      /* This should not happen */
+      perror("total-lockdown");
+      audit_attempt(AUDIT_ERROR, length);
+      platform->sleep(5);
+      return 2;
+    }
+  
+  if (!revoked && !strcmp(passphrase_crypt, encrypted))
+    {
+      audit_attempt(AUDIT_SUCCESS, length);
+      return 0;
+    }
+  
+  audit_attempt(AUDIT_FAILURE, length);
+  platform->sleep(3);
+  return 1;
+}
+
+
+/**
+ * Prompt for, read and verify a passphrase, runs in its own process
+ * 
+ * @param   arg  `const struct lock*`
+ * @return       `ATTEMPT_SUCCESS` if the passphrase was correct,
+ *               `ATTEMPT_INPUT_LOST` if the keyboard was lost,
+ *               otherwise a non-zero value
+ */
+static int attempt(const void* arg)
+{
+  const struct lock* lock = arg;
+  struct verification verification;
+  char prompt[256];
+  int fds_pipe[2];
+  int status, lost;
+  pid_t pid;
+  
+  if (pipe(fds_pipe))
+    abort();
+  
+  verification.fd = fds_pipe[0];
+  verification.write_fd = fds_pipe[1];
+  verification.encrypted = lock->encrypted;
+  verification.refresh = lock->refresh;
+  if ((pid = platform->spawn(verifier, &verification)) == (pid_t)-1)
+    abort();
+  
+#ifdef DEBUG
+  alarm(60); /* when testing, we are aborting after 60 seconds */
+#endif
+  
+  if (lock->name == NULL)
+    snprintf(prompt, sizeof(prompt), "Enter passphrase: ");
+  else
+    snprintf(prompt, sizeof(prompt), "Enter passphrase for %s: ", lock->name);
+  platform->print("\n");
+  
+  /* the keyboard driver prints the prompt, since it may have to update it,
+   * a forked attempt starts with a fresh driver, a simulated one does not */
+  kbddriver_reset();
+  lost = lock->unicode ? readtty(fds_pipe[1], prompt) : readkbd(fds_pipe[1], prompt);
+  
+  /* if the keyboard was lost, there is no passphrase to verify, kill
+   * the verifier while it still waits for the line, before it sees the
+   * end of the pipe and reports the partial line as a failure */
+  if (lost)
+    platform->kill(pid, SIGKILL);
+  close(fds_pipe[1]);
+  verification.write_fd = -1;
+  while (platform->wait(pid, &status) == (pid_t)-1)
+    if (errno != EINTR)
+      {
+	status = W_EXITCODE(1, 0); /* treat it as a wrong passphrase */
+	break;
+      }
+  close(fds_pipe[0]);
+  
+  if (lost)
+    return ATTEMPT_INPUT_LOST;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+
+/**
+ * Engage the lock on the console
+ * 
+ * @param   checkpoint  The sealed console settings
+ * @return              Zero on success, -1 on error
+ */
+static int engage(const struct checkpoint* checkpoint)
+{
+  int rc = 0;
+  if (platform->tcsetattr(STDIN_FILENO, TCSAFLUSH, &(checkpoint->locked_stty)))
+    rc = -1;
+  if (platform->setkbmode(STDIN_FILENO, checkpoint->locked_kbd_mode))
+    rc = -1;
+  return rc;
+}
+
+
+/**
+ * Run attempts until one succeeds, runs in its own process
+ * 
+ * @param   arg  `const struct guardian*`
+ * @return       `ATTEMPT_SUCCESS` if the passphrase was correct,
+ *               `ATTEMPT_INPUT_LOST` if the keyboard was lost,
+ *               `GUARD_FAILED` if an attempt could not be run
+ */
+static int guard(const void* arg)
+{
+  const struct guardian* guardian = arg;
+  int status;
+  pid_t pid;
+  
+  /* SIGUSR1 only asks the process that started the lock for a
+   * report, the attempts and their verifiers inherit this, so
+   * that spawning them does not cost anything extra. */
+  signal(SIGUSR1, SIG_IGN);
+  
+  for (;;)
+    {
+      if ((pid = platform->spawn(attempt, guardian->lock)) == (pid_t)-1)
+	return GUARD_FAILED;
+      while (platform->wait(pid, &status) == (pid_t)-1)
+	if (errno != EINTR)
+	  return GUARD_FAILED;
+      if (WIFEXITED(status))
+	{
+	  if (WEXITSTATUS(status) == ATTEMPT_SUCCESS)
+	    return ATTEMPT_SUCCESS;
+	  if (WEXITSTATUS(status) == ATTEMPT_INPUT_LOST)
+	    return ATTEMPT_INPUT_LOST;
+	}
+#ifdef DEBUG
+      if (WIFSIGNALED(status) && (WTERMSIG(status) == SIGALRM))
+	return ATTEMPT_SUCCESS; /* the testing timeout */
+#endif
+      
+      /* We do not know what a failed attempt did to the console
+       * before it exited, so re-engage the lock before the next. */
+      engage(guardian->checkpoint);
+    }
+}
+
+
+/**
+ * Store the console settings in a sealed, read-only memory, so
+ * that not even a memory fault in the lock can modify them
+ * 
+ * @param   state     The settings
+ * @param   fallback  Where to store the settings if sealed
+ *                    memory is not available
+ * @return            The stored settings
+ */
+static struct checkpoint* checkpoint_create(const struct checkpoint* state, struct checkpoint* fallback)
+{
+  void* mem;
+  int fd;
+  
+  if ((fd = memfd_create("total-lockdown", MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0)
+    goto fail;
+  if (write(fd, state, sizeof(*state)) != (ssize_t)sizeof(*state))
+    goto fail_close;
+  if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL))
+    goto fail_close;
+  mem = mmap(NULL, sizeof(*state), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED)
+    goto fail;
+  return mem;
+  
+ fail_close:
+  close(fd);
+ fail:
+  *fallback = *state;
+  return fallback;
+}
+
+
+/**
+ * Lock the console on stdin until the user has entered the
+ * right passphrase, the terminal attributes and keyboard mode
+ * are restored before returning zero
+ * 
+ * The lock runs on `platform`, and it must never wake up
+ * while there is no input, anything that is added to it
+ * must block rather than poll or use timers
+ * 
+ * @param   lock  How to lock the console
+ * @return        Zero when unlocked, 1 if the lock could not be
+ *                engaged, in which case the console has been
+ *                restored, -1 if the lock could not be maintained,
+ *                in which case the console is left locked
+ */
+int lockdown(const struct lock* lock)
+{
+  struct checkpoint state;
+  struct checkpoint fallback;
+  struct checkpoint* checkpoint; /* read-only */
+  struct guardian guardian;
+  int status, rc = 0;
+  pid_t pid;
+  
+  platform->tcgetattr(STDIN_FILENO, &(state.saved_stty));
+  platform->getkbmode(STDIN_FILENO, &(state.saved_kbd_mode));
+  state.locked_stty = state.saved_stty;
+  state.locked_stty.c_lflag &= 0 /* (tcflag_t)~(ECHO | ICANON | ISIG) */;
+  state.locked_stty.c_iflag = 0;
+  state.locked_kbd_mode = lock->unicode
+    ? K_UNICODE    /* The keymap has no way out, so the kernel can decode it. */
+    : K_MEDIUMRAW; /* Now we have full access to the keyboard, the intruder cannot change
+		    * TTY, but we need to implement RESTRICTED kernel keyboard support. */
+  checkpoint = checkpoint_create(&state, &fallback);
+  
+  if (engage(checkpoint))
+    {
+      /* we may not be allowed to lock this console, do not claim that it is locked */
+      platform->setkbmode(STDIN_FILENO, checkpoint->saved_kbd_mode);
+      platform->tcsetattr(STDIN_FILENO, TCSAFLUSH, &(checkpoint->saved_stty));
+      rc = 1;
+      goto done;
+    }
+  if (lock->notify >= 0)
+    {
+      /* if whoever requested the lock has given up waiting, that is fine */
+      send(lock->notify, "locked\n", 7, MSG_NOSIGNAL | MSG_DONTWAIT);
+      close(lock->notify);
+    }
+  
+  /* We are the supervisor, we only wait. The attempts are run by a
+   * guard process, and each attempt runs in its own process, so that
+   * a memory fault cannot modify the saved settings. If the guard
+   * dies, by a crash or by being killed, we re-engage the lock from
+   * the sealed settings and start a new guard. Only if we ourself
+   * are killed is the console left locked with nobody to unlock it. */
+  guardian.lock = lock;
+  guardian.checkpoint = checkpoint;
+  for (;;)
+    {
+      if ((pid = platform->spawn(guard, &guardian)) == (pid_t)-1)
+	{
+	  rc = -1;
+	  goto done;
+	}
+      while (platform->wait(pid, &status) == (pid_t)-1)
+	{
+	  if (errno != EINTR)
+	    {
+	      rc = -1;
+	      goto done;
+	    }
+	  if (lock->interrupted)
+	    lock->interrupted();
+	}
+      if (WIFEXITED(status))
+	{
+	  if (WEXITSTATUS(status) == ATTEMPT_SUCCESS)
+	    break;
+	  if ((WEXITSTATUS(status) == ATTEMPT_INPUT_LOST) || (WEXITSTATUS(status) == GUARD_FAILED))
+	    {
+	      rc = -1;
+	      goto done;
+	    }
+	}
+      
+      engage(checkpoint);
+    }
+  
+  /* unlock */
+  platform->setkbmode(STDIN_FILENO, checkpoint->saved_kbd_mode);
+  platform->tcsetattr(STDIN_FILENO, TCSAFLUSH, &(checkpoint->saved_stty));
+  
+ done:
+  if (checkpoint != &fallback)
+    munmap(checkpoint, sizeof(*checkpoint));
+  return rc;
+}
+
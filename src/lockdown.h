@@ -0,0 +1,90 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_LOCKDOWN_H
+#define TOTAL_LOCKDOWN_LOCKDOWN_H
+
+
+
+/**
+ * How to lock the console
+ */
+struct lock
+{
+  /**
+   * The real user's name, `NULL` if unknown
+   */
+  const char* name;
+  
+  /**
+   * The real user's encrypted passphrase
+   */
+  const char* encrypted;
+  
+  /**
+   * Called once each passphrase has been entered, returns the
+   * latest encrypted passphrase, or `NULL` to keep `encrypted`,
+   * may be `NULL`, it must not block, a passphrase that starts
+   * with '!' or '*', like a locked account's, never matches
+   */
+  const char* (*refresh)(void);
+  
+  /**
+   * Called when the supervisor, the process that called
+   * `lockdown`, is interrupted by a signal, may be `NULL`
+   */
+  void (*interrupted)(void);
+  
+  /**
+   * Whether the kernel decodes the keyboard
+   * (with a restricted keymap), rather than us
+   */
+  int unicode;
+  
+  /**
+   * Socket that a line is sent to, and that is then
+   * closed, once the keyboard is grabbed, -1 if none,
+   * nothing is sent if the keyboard cannot be grabbed
+   */
+  int notify;
+};
+
+
+/**
+ * Lock the console on stdin until the user has entered the
+ * right passphrase, the terminal attributes and keyboard mode
+ * are restored before returning zero
+ * 
+ * The calling process supervises the lock, if the process
+ * that runs the attempts dies, the lock is re-engaged and a
+ * new one is started
+ * 
+ * The lock runs on `platform`, and it must never wake up
+ * while there is no input, anything that is added to it
+ * must block rather than poll or use timers
+ * 
+ * @param   lock  How to lock the console
+ * @return        Zero when unlocked, 1 if the lock could not be
+ *                engaged, in which case the console has been
+ *                restored, -1 if the lock could not be maintained,
+ *                in which case the console is left locked
+ */
+int lockdown(const struct lock* lock);
+
+
+#endif
+
@@ -0,0 +1,161 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "platform.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <signal.h>
+#include <linux/kd.h>
+#include <passphrase.h>
+
+
+
+/**
+ * Get the console's keyboard mode
+ * 
+ * @param   fd    File descriptor for the console
+ * @param   mode  Output parameter for the mode
+ * @return        Zero on success, -1 on error
+ */
+static int native_getkbmode(int fd, int* mode)
+{
+  return ioctl(fd, KDGKBMODE, mode);
+}
+
+
+/**
+ * Set the console's keyboard mode
+ * 
+ * @param   fd    File descriptor for the console
+ * @param   mode  The mode
+ * @return        Zero on success, -1 on error
+ */
+static int native_setkbmode(int fd, int mode)
+{
+  return ioctl(fd, KDSKBMODE, mode);
+}
+
+
+/**
+ * Print a text on the lock screen, which is stdout
+ * 
+ * @param  text  The text
+ */
+static void native_print(const char* text)
+{
+  fputs(text, stdout);
+  fflush(stdout);
+}
+
+
+/**
+ * Run a function in a forked process, the process is
+ * killed if its parent dies, so that an attempt does
+ * not keep reading the keyboard after its guard has
+ * been replaced
+ * 
+ * @param   function  The function
+ * @param   arg       Argument for the function
+ * @return            The process ID, -1 on error
+ */
+static pid_t native_spawn(int (*function)(const void* arg), const void* arg)
+{
+  pid_t parent = getpid();
+  pid_t pid = fork(); /* We do not use vfork, since we want to be absolutely
+		       * sure that the saved settings are not modified by a
+		       * memory fault. That could lock the keyboard and force
+		       * manual reboot via physical button. (Or an too elaborate
+		       * reset over SSH.) */
+  if (pid == 0)
+    {
+      if (prctl(PR_SET_PDEATHSIG, SIGKILL) || (getppid() != parent))
+	_exit(1);
+      exit(function(arg));
+    }
+  return pid;
+}
+
+
+/**
+ * Wait for a process to exit
+ * 
+ * @param   pid     The process ID
+ * @param   status  Output parameter for the status
+ * @return          `pid` on success, -1 on error
+ */
+static pid_t native_wait(pid_t pid, int* status)
+{
+  return waitpid(pid, status, 0);
+}
+
+
+/**
+ * Read a passphrase from a pipe, the pipe replaces stdin
+ * 
+ * @param   fd  The read end of the pipe
+ * @return      The passphrase
+ */
+static char* native_readpass(int fd)
+{
+  close(STDIN_FILENO);
+  dup2(fd, STDIN_FILENO);
+  return passphrase_read();
+}
+
+
+/**
+ * Get the monotonic time
+ * 
+ * @param  time  Output parameter for the time
+ */
+static void native_now(struct timespec* time)
+{
+  clock_gettime(CLOCK_MONOTONIC, time);
+}
+
+
+
+/**
+ * The real operating system
+ */
+const struct platform platform_native =
+  {
+    .ttyname   = ttyname,
+    .tcgetattr = tcgetattr,
+    .tcsetattr = tcsetattr,
+    .getkbmode = native_getkbmode,
+    .setkbmode = native_setkbmode,
+    .read      = read,
+    .print     = native_print,
+    .spawn     = native_spawn,
+    .wait      = native_wait,
+    .kill      = kill,
+    .readpass  = native_readpass,
+    .sleep     = sleep,
+    .now       = native_now
+  };
+
+/**
+ * The platform the lock runs on, `&platform_native` by default
+ */
+const struct platform* platform = &platform_native;
+
@@ -0,0 +1,119 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_PLATFORM_H
+#define TOTAL_LOCKDOWN_PLATFORM_H
+
+
+#include <sys/types.h>
+#include <termios.h>
+#include <time.h>
+
+
+
+/**
+ * The operating system services used by the lock,
+ * so that the lock can be run against a simulation
+ */
+struct platform
+{
+  /**
+   * Get the pathname of a terminal, see ttyname(3)
+   */
+  char* (*ttyname)(int fd);
+  
+  /**
+   * Get a terminal's attributes, see tcgetattr(3)
+   */
+  int (*tcgetattr)(int fd, struct termios* attr);
+  
+  /**
+   * Set a terminal's attributes, see tcsetattr(3)
+   */
+  int (*tcsetattr)(int fd, int action, const struct termios* attr);
+  
+  /**
+   * Get the console's keyboard mode, the KDGKBMODE ioctl
+   */
+  int (*getkbmode)(int fd, int* mode);
+  
+  /**
+   * Set the console's keyboard mode, the KDSKBMODE ioctl
+   */
+  int (*setkbmode)(int fd, int mode);
+  
+  /**
+   * Read input from the keyboard, see read(2)
+   */
+  ssize_t (*read)(int fd, void* buf, size_t n);
+  
+  /**
+   * Print a text on the lock screen
+   */
+  void (*print)(const char* text);
+  
+  /**
+   * Run a function in a new process, see fork(2), the
+   * return value of the function is the exit status
+   * 
+   * @return  The process ID, -1 on error
+   */
+  pid_t (*spawn)(int (*function)(const void* arg), const void* arg);
+  
+  /**
+   * Wait for a spawned process to exit, see waitpid(2)
+   */
+  pid_t (*wait)(pid_t pid, int* status);
+  
+  /**
+   * Send a signal to a spawned process, see kill(2)
+   */
+  int (*kill)(pid_t pid, int signo);
+  
+  /**
+   * Read a passphrase from a pipe, it is only called in
+   * a process of its own, and ownership of the returned
+   * buffer is passed to the caller
+   */
+  char* (*readpass)(int fd);
+  
+  /**
+   * Sleep, see sleep(3)
+   */
+  unsigned int (*sleep)(unsigned int seconds);
+  
+  /**
+   * Get the monotonic time
+   */
+  void (*now)(struct timespec* time);
+};
+
+
+
+/**
+ * The real operating system
+ */
+extern const struct platform platform_native;
+
+/**
+ * The platform the lock runs on, `&platform_native` by default
+ */
+extern const struct platform* platform;
+
+
+#endif
+
@@ -15,22 +15,31 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
-#include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
-#include <stdarg.h>
-#include <termios.h>
-#include <sys/ioctl.h>
-#include <sys/wait.h>
-#include <inttypes.h>
-#include <linux/kd.h>
-#include <crypt.h>
+#include <signal.h>
 #include <string.h>
-#include <passphrase.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
 
 #include "security.h"
+#include "audit.h"
+#include "keymap.h"
+#include "screen.h"
+#include "platform.h"
+#include "lockdown.h"
+#include "daemon.h"
+#include "idle.h"
+#include "refresh.h"
 #include "kbddriver.h"
+#include "kbddecoder.h"
+#include "usage.h"
+#include "vt.h"
 
 
 #if defined(EBUG) && !defined(DEBUG)
@@ -44,149 +53,767 @@
 #endif
 
 
-int verifier(int fd, char* encrypted);
+/**
+ * The number of users whose identities are remembered
+ */
+#define MAX_IDENTITIES  16
 
+/**
+ * The number of requesters that can wait for the daemon's lock
+ */
+#define MAX_WAITING  16
 
-int main(int argc, char** argv)
+#ifdef DEBUG
+/**
+ * The encrypted passphrase used when the user's cannot be looked up,
+ * the passphrase is ‘ppp’, this is needed when testing without setuid
+ * permission, which is needed for valgrind
+ */
+# define DEBUG_ENCRYPTED  "$6$MWcK52I9$xKtRFG3JIRfuC80R/8fu3vDO6qPRy6IK6B8GsaA6n.HvdP8J3M9n0.nNc/ZcdkzHWApXCVsQBk4V.YGsmfkNv1"
+#endif
+
+
+
+/**
+ * A user who may unlock a lock
+ */
+struct identity
 {
-  struct termios stty;
-  struct termios saved_stty;
-  int saved_kbd_mode;
-  pid_t pid;
-  char* tty;
-  char* encrypted;
+  /**
+   * The user
+   */
+  uid_t uid;
+  
+  /**
+   * The user's name, `NULL` if unknown
+   */
   char* name;
   
-  /* verify that we are in a real VT, otherwise we cannot possibly lock it down */
-  tty = ttyname(STDIN_FILENO);
-  if (strstr(tty, "/dev/tty") != tty)
+  /**
+   * The user's encrypted passphrase
+   */
+  char* encrypted;
+};
+
+
+
+/**
+ * The process that owns the restricted keymap
+ */
+static pid_t lock_pid;
+
+
+/**
+ * Whether a usage report has been requested with SIGUSR1
+ */
+static volatile sig_atomic_t usage_requested = 0;
+
+
+/**
+ * Request a usage report, it is made once the
+ * lock notices that it has been interrupted
+ * 
+ * @param  signo  The received signal
+ */
+static void request_usage(int signo)
+{
+  (void) signo;
+  usage_requested = 1;
+}
+
+
+/**
+ * Make a usage report if one has been requested
+ */
+static void report_usage(void)
+{
+  if (usage_requested)
     {
-      fprintf(stderr, "A Linux console is required (as stdin).\n");
-      return 1;
+      usage_requested = 0;
+      usage_report("while locked");
     }
+}
+
+
+/**
+ * Restore the kernel keymap, with privileges, since only
+ * root may change the secure attention key
+ */
+static void unrestrict(void)
+{
+  seteuid(0);
+  keymap_restore(STDIN_FILENO);
+  seteuid(getuid());
+}
+
+
+/**
+ * Restore the kernel keymap if the lock is terminated, it is
+ * shared by all VTs so it must not be left restricted
+ * 
+ * @param  signo  The received signal
+ */
+static void restore_keymap(int signo)
+{
+  if (getpid() == lock_pid)
+    unrestrict();
+  signal(signo, SIG_DFL);
+  raise(signo);
+}
+
+
+/**
+ * Exempt the lock from the OOM killer, SIGKILL cannot be caught,
+ * so if the process that supervises the lock is killed, the console
+ * is left locked, and a restricted keymap is left restricted on all
+ * VTs, the processes it spawns inherit the exemption
+ * 
+ * @param   saved  Output buffer for the previous setting, it
+ *                 is left empty if the setting is not changed
+ * @param   size   The size of `saved`
+ * @return         The setting, to pass to `oom_restore`, -1 on error
+ */
+static int oom_exempt(char* saved, size_t size)
+{
+  ssize_t got;
+  int fd, saved_errno;
+  
+  /* we are not dumpable, so the file belongs to root, and only root may lower the setting */
+  *saved = '\0';
+  seteuid(0);
+  if ((fd = open("/proc/self/oom_score_adj", O_RDWR | O_CLOEXEC)) < 0)
+    goto fail;
+  if ((got = read(fd, saved, size - 1)) <= 0)
+    goto fail;
+  saved[got] = '\0';
+  if (pwrite(fd, "-1000\n", 6, 0) != 6)
+    goto fail;
+  seteuid(getuid());
+  return fd;
   
-  /* get the real user's real name or username */
-  name = getname();
+ fail:
+  saved_errno = errno;
+  seteuid(getuid());
+  if (fd >= 0)
+    close(fd);
+  *saved = '\0';
+  errno = saved_errno;
+  perror("total-lockdown: the lock is not exempt from the OOM killer");
+  return -1;
+}
+
+
+/**
+ * Undo `oom_exempt`, raising the setting does not need privileges,
+ * and the file is already open
+ * 
+ * @param  fd     The setting, as returned by `oom_exempt`
+ * @param  saved  The previous setting
+ */
+static void oom_restore(int fd, const char* saved)
+{
+  if (fd < 0)
+    return;
+  if (pwrite(fd, saved, strlen(saved), 0) < 0)
+    perror("total-lockdown");
+  close(fd);
+}
+
+
+/**
+ * Load the console's layout, so that we can decode the keyboard,
+ * with the console's layout first and the built-in layout second,
+ * this takes thousands of ioctls, so it is only done once, the
+ * kernel keymap is shared by all VTs, so any console will do
+ * 
+ * @param   fd  File descriptor for a console
+ * @return      The console's layout, `NULL` if only the built-in
+ *              layout is used, it should be released with `keymap_unload`
+ */
+static const struct kbdlayout* load_layouts(int fd)
+{
+  const struct kbdlayout* layouts[2];
+  layouts[0] = keymap_load(fd);
+  layouts[1] = &kbdlayout_default;
+  kbddriver_layouts(layouts[0] ? layouts : layouts + 1, layouts[0] ? 2 : 1);
+  return layouts[0];
+}
+
+
+/**
+ * Lock the console on stdin, and unlock it once the user
+ * has been authenticated, unless the kernel decodes the
+ * keyboard, the layouts must already have been loaded
+ * 
+ * @param   name            The user's name, `NULL` if unknown
+ * @param   encrypted       The user's encrypted passphrase
+ * @param   refresh         Whether passphrase changes should be picked up,
+ *                          this is only done for the real user
+ * @param   unicode         Whether the kernel should decode the keyboard
+ * @param   restore_screen  Whether to restore the screen from the
+ *                          snapshot, rather than clearing it
+ * @param   notify          Socket to notify once locked, -1 if none
+ * @return                  The exit status for the program
+ */
+static int engage(const char* name, const char* encrypted, int refresh, int unicode, int restore_screen, int notify)
+{
+  static const int fatal_signals[] = { SIGHUP, SIGINT, SIGQUIT, SIGILL, SIGABRT, SIGFPE,
+				       SIGSEGV, SIGBUS, SIGTERM, SIGPIPE, SIGALRM };
+  char oom_score_adj[16];
+  struct sigaction action;
+  struct lock lock;
+  int restricted, saved_errno, rc, oom;
+  size_t i;
   
-  /* get the real user's encrypted passphrase */
-  if ((encrypted = getcrypt()) == NULL)
+  /* blank every key in the kernel keymap that could be used to leave the VT */
+  if (unicode)
     {
-#ifndef DEBUG
-      return 2;
-#else
-      encrypted = "$6$MWcK52I9$xKtRFG3JIRfuC80R/8fu3vDO6qPRy6IK6B8GsaA6n.HvdP8J3M9n0.nNc/ZcdkzHWApXCVsQBk4V.YGsmfkNv1";
-      /* Passphrase is ‘ppp’ when testing without setuid permission, which is needed for valgrind. */
-#endif
+      lock_pid = getpid();
+      for (i = 0; i < sizeof(fatal_signals) / sizeof(*fatal_signals); i++)
+	signal(fatal_signals[i], restore_keymap);
+      seteuid(0); /* the secure attention key can only be changed with CAP_SYS_ADMIN */
+      restricted = keymap_restrict(STDIN_FILENO);
+      saved_errno = errno;
+      seteuid(getuid());
+      if (restricted)
+	{
+	  errno = saved_errno;
+	  perror("total-lockdown");
+	  return 3;
+	}
+      if (keymap_audit(STDIN_FILENO))
+	{
+	  unrestrict();
+	  fprintf(stderr, "The keymap could not be restricted, refusing to lock.\n");
+	  return 3;
+	}
     }
   
   /* lock down */
+  if (restore_screen)
+    screen_save();
 #ifndef DEBUG
   printf("\033[H\033[2J\033[3J"); /* \e[3J should (but will probably not) erase the scrollback */
 #endif
   fflush(stdout);
-  tcgetattr(STDIN_FILENO, &saved_stty);
-  stty = saved_stty;
-  stty.c_lflag &= 0 /* (tcflag_t)~(ECHO | ICANON | ISIG) */;
-  stty.c_iflag = 0;
-  tcsetattr(STDIN_FILENO, TCSAFLUSH, &stty);
-  ioctl(STDIN_FILENO, KDGKBMODE, &saved_kbd_mode);
-  ioctl(STDIN_FILENO, KDSKBMODE, K_MEDIUMRAW); /* Now we have full access to the keyboard, the
-						* intruder cannot change TTY, but we need to
-					        * implement RESTRICTED kernel keyboard support. */
-  
-  printf("\n");
- retry:
-  if ((pid = fork()) == (pid_t)-1)
-    return 10; /* We do not use vfork, since we want to be absolutely
-		* sure that the saved settings are not modified by a
-		* memory fault. That could lock the keyboard and force
-		* manual reboot via physical button. (Or an too elaborate
-		* reset over SSH.) */
-  
-  if (pid)
-    waitpid(pid, NULL, 0);
-  else
+  lock.name = name;
+  lock.encrypted = encrypted;
+  lock.refresh = refresh ? refresh_get : NULL;
+  lock.unicode = unicode;
+  lock.notify = notify;
+  lock.interrupted = report_usage;
+  
+  /* account for what the lock costs, it should not wake up at all while
+   * nobody is typing, SA_RESTART is not used, so that the lock notices */
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = request_usage;
+  sigemptyset(&(action.sa_mask));
+  sigaction(SIGUSR1, &action, NULL);
+  usage_start();
+  
+  oom = oom_exempt(oom_score_adj, sizeof(oom_score_adj));
+  if ((rc = lockdown(&lock)) < 0)
+    return 10;
+  
+  /* unlock, or undo everything if the lock could not be engaged */
+  oom_restore(oom, oom_score_adj);
+  if (rc == 0)
+    usage_report("at unlock");
+  if (unicode)
+    unrestrict();
+  fflush(stdout); /* anything still buffered must be written before the screen is restored */
+  if (screen_restore())
     {
-      int fd, fd_child;
-      int fds_pipe[2];
-      
-      if (pipe(fds_pipe))
-	abort();
-      
-      if ((pid = fork()) == (pid_t)-1)
-	abort();
-      
-#ifdef DEBUG
-      alarm(60); /* when testing, we are aborting after 60 seconds */
+#ifndef DEBUG
+      printf("\033[H\033[2J");
 #endif
-      
-      fd = fds_pipe[1];
-      fd_child = fds_pipe[0];
-      
-      if (!pid)
-	return verifier(fd_child, encrypted);
-      else
-	{
-	  int status;
-	  
-	  if (name == NULL)
-	    printf("    Enter passphrase: ");
-	  else
-	    printf("    Enter passphrase for %s: ", name);
-	  fflush(stdout);
-	  
-	  readkbd(fd);
-	  waitpid(pid, &status, 0);
-	  
-	  close(fds_pipe[0]);
-	  close(fds_pipe[1]);
-	  
-	  if (WIFEXITED(status) ? WEXITSTATUS(status) : 1)
-	    goto retry;
-	  return 0;
-	}
+      fflush(stdout);
     }
   
-  /* unlock */
-  ioctl(STDIN_FILENO, KDSKBMODE, saved_kbd_mode);
-  tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_stty);
-#ifndef DEBUG
-  printf("\033[H\033[2J");
-#endif
-  fflush(stdout);
+  if (rc)
+    {
+      fprintf(stderr, "The console could not be locked.\n");
+      return 4;
+    }
+  return 0;
+}
+
+
+/**
+ * The lock started by the daemon, zero if none
+ */
+static volatile pid_t active_lock = 0;
+
+
+/**
+ * The daemon's end of the socket the active lock notifies
+ * once it is engaged, -1 if it has been read
+ */
+static int engaged_fd = -1;
+
+/**
+ * Whether the active lock is engaged
+ */
+static int engaged = 0;
+
+/**
+ * The requesters waiting for the active lock to be engaged
+ */
+static int waiting[MAX_WAITING];
+
+/**
+ * The number of used elements in `waiting`
+ */
+static size_t waiting_count = 0;
+
+
+
+/**
+ * Tell everyone waiting for the daemon's lock whether it
+ * has been engaged, those who are told that it has not
+ * are hung up on, the requester takes that as a failure
+ */
+static void answer(void)
+{
+  for (; waiting_count; waiting_count--)
+    {
+      if (engaged)
+	send(waiting[waiting_count - 1], "locked\n", 7, MSG_NOSIGNAL | MSG_DONTWAIT);
+      close(waiting[waiting_count - 1]);
+    }
+}
+
+
+/**
+ * Wait for a request, or for the active lock to be engaged
+ * 
+ * @param   listener  The listening socket, it must be non-blocking
+ * @param   vt        Output parameter for the VT to lock
+ * @return            The connection, -1 if there was no request
+ *                    or on error, in which case `errno` is set
+ *                    to `EAGAIN` or `EINTR` if it was not an error
+ */
+static int next_request(int listener, int* vt)
+{
+  struct pollfd fds[2];
+  char message[16];
   
-  if (name)
-    free(name);
+  fds[0].fd = listener, fds[0].events = POLLIN, fds[0].revents = 0;
+  fds[1].fd = engaged_fd, fds[1].events = POLLIN, fds[1].revents = 0;
+  if (poll(fds, engaged_fd < 0 ? 1 : 2, -1) < 0)
+    return -1;
+  
+  /* the lock closes its end once it is engaged, or if it fails */
+  if (fds[1].revents)
+    {
+      engaged = recv(engaged_fd, message, sizeof(message), MSG_DONTWAIT) > 0;
+      close(engaged_fd);
+      engaged_fd = -1;
+      answer();
+    }
+  
+  if (!fds[0].revents)
+    {
+      errno = EAGAIN;
+      return -1;
+    }
+  return daemon_accept(listener, vt);
+}
+
+
+/**
+ * Reap the daemon's locks, and forget the active
+ * lock once it has ended
+ * 
+ * @param  signo  The received signal
+ */
+static void reap(int signo)
+{
+  int saved_errno = errno;
+  int status;
+  pid_t pid;
+  (void) signo;
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    if (pid == active_lock)
+      active_lock = 0;
+  errno = saved_errno;
+}
+
+
+/**
+ * Check whether the user, group or shadow database has been
+ * changed since the last time, this only takes a stat(2) for
+ * each, the databases are replaced by renaming, so the inode
+ * number changes as well as the modification time
+ * 
+ * @return  Whether any of the databases has been changed
+ */
+static int databases_changed(void)
+{
+  static const char* const databases[] = { "/etc/passwd", "/etc/shadow", "/etc/group" };
+  static struct stat last[sizeof(databases) / sizeof(*databases)];
+  struct stat attr;
+  int changed = 0;
+  size_t i;
   
-  return (pid == (pid_t)-1) ? 10 : 0;
+  for (i = 0; i < sizeof(databases) / sizeof(*databases); i++)
+    {
+      if (stat(databases[i], &attr))
+	memset(&attr, 0, sizeof(attr));
+      if ((attr.st_ino != last[i].st_ino) || (attr.st_mtim.tv_sec != last[i].st_mtim.tv_sec) ||
+	  (attr.st_mtim.tv_nsec != last[i].st_mtim.tv_nsec) || (attr.st_size != last[i].st_size))
+	changed = 1;
+      last[i] = attr;
+    }
+  return changed;
 }
 
 
-int verifier(int fd, char* encrypted)
+/**
+ * Find out who may unlock a lock, the identities are remembered
+ * until the user, group or shadow database is changed, so that
+ * the daemon does not look anyone up more than once
+ * 
+ * @param   uid  The user
+ * @return       The user's identity, `NULL` if the user may not lock
+ */
+static const struct identity* identify(uid_t uid)
 {
-  char* passphrase;
-  char* passphrase_crypt;
+  static struct identity identities[MAX_IDENTITIES];
+  static size_t count = 0;
+  struct identity* identity;
+  char* encrypted;
+  size_t i;
+  
+  if (databases_changed() || (count == MAX_IDENTITIES))
+    for (; count; count--)
+      {
+	free(identities[count - 1].name);
+	free(identities[count - 1].encrypted);
+      }
+  for (i = 0; i < count; i++)
+    if (identities[i].uid == uid)
+      return identities + i;
+  
+  /* if we were not installed with setuid, try anyway, getcrypt drops the privileges */
+  seteuid(0);
+  encrypted = getcrypt(uid);
+#ifdef DEBUG
+  if (encrypted == NULL)
+    encrypted = DEBUG_ENCRYPTED;
+#endif
+  if (encrypted == NULL)
+    return NULL; /* not remembered, the user may become authorised */
+  
+  identity = identities + count;
+  identity->uid = uid;
+  identity->name = getname(uid);
+  if ((identity->encrypted = strdup(encrypted)) == NULL)
+    {
+      free(identity->name);
+      return NULL;
+    }
+  count++;
+  return identity;
+}
+
+
+/**
+ * Find out who may unlock a VT, that is its owner, who is logged in on it
+ * 
+ * @param   vt  The VT
+ * @return      The owner's identity, `NULL` if the owner may not lock
+ */
+static const struct identity* owner(int vt)
+{
+  char tty[sizeof("/dev/tty") + 3 * sizeof(int)];
+  struct stat attr;
+  sprintf(tty, "/dev/tty%i", vt);
+  if (stat(tty, &attr))
+    attr.st_uid = getuid();
+  return identify(attr.st_uid);
+}
+
+
+/**
+ * Lock the console on request, or when idle, runs in its own process
+ * 
+ * The lock runs on a VT of its own, rather than on the requested
+ * VT, so that whatever runs on the requested VT cannot read the
+ * keyboard while the lock does, the lock's VT is made the controlling
+ * terminal, so that the keyboard mode can be changed without
+ * CAP_SYS_TTY_CONFIG
+ * 
+ * Everything else has already been prepared, so that
+ * only the VT has to be allocated and switched to
+ * 
+ * @param   vt          The VT to lock
+ * @param   connection  The requester, it is notified once locked, -1 if none
+ * @param   identity    Who may unlock, see `owner`
+ * @param   unicode     Whether the kernel should decode the keyboard
+ * @return              The exit status for the process
+ */
+static int serve(int vt, int connection, const struct identity* identity, int unicode)
+{
+  int fd, lock_vt, rc;
+  
+  signal(SIGCHLD, SIG_DFL); /* the lock waits for its attempts */
+  setsid();
+  
+  /* the daemon has dropped its privileges, but we need them to open the console */
+  seteuid(0); /* if we were not installed with setuid, try anyway */
+  fd = vt_open(&lock_vt);
+  if ((fd >= 0) && vt_switch(lock_vt))
+    {
+      close(fd);
+      vt_release(lock_vt);
+      fd = -1;
+    }
+  seteuid(getuid());
+  if (fd < 0)
+    return 1;
   
-  close(STDIN_FILENO);
   dup2(fd, STDIN_FILENO);
+  dup2(fd, STDOUT_FILENO);
+  dup2(fd, STDERR_FILENO);
+  if (fd > STDERR_FILENO)
+    close(fd);
+  
+  /* we only refresh the real user's passphrase, the VT normally belongs
+   * to someone else when we run as root, for example when socket activated */
+  rc = engage(identity->name, identity->encrypted, identity->uid == getuid(), unicode, 0, connection);
+  if (rc == 10)
+    return rc; /* still locked, stay on the lock's VT */
+  
+  /* give the console back */
+  close(STDIN_FILENO);
+  close(STDOUT_FILENO);
+  close(STDERR_FILENO);
+  seteuid(0);
+  vt_switch(vt);
+  vt_release(lock_vt);
+  seteuid(getuid());
+  return rc;
+}
+
+
+int main(int argc, char** argv)
+{
+  int unicode = 0;
+  int restore_screen = 1;
+  int resident = 0;
+  int idle = 0;
+  int listener = -1;
+  const struct kbdlayout* console = NULL;
+  struct sigaction action;
+  sigset_t children, mask;
+  pid_t pid;
+  int connection;
+  int pair[2];
+  int fd;
+  int vt;
+  int rc;
+  const struct identity* identity = NULL;
+  char* tty;
+  size_t i;
+  
+  /* SIGUSR1 asks the lock for a usage report, anything else we start,
+   * such as the audit writer, the refresher and the daemon, ignores it */
+  signal(SIGUSR1, SIG_IGN);
+  
+  for (i = 1; i < (size_t)argc; i++)
+    if (!strcmp(argv[i], "--unicode"))
+      unicode = 1; /* let the kernel decode the keyboard, with a restricted keymap */
+    else if (!strcmp(argv[i], "--no-restore"))
+      restore_screen = 0; /* do not keep a copy of the screen while locked */
+    else if (!strcmp(argv[i], "--daemon"))
+      resident = 1; /* stay resident and lock VT:s on request */
+    else if (!strcmp(argv[i], "--idle") && (i + 1 < (size_t)argc) && ((idle = atoi(argv[i + 1])) > 0))
+      i++; /* lock whenever no input has been made for a number of seconds */
+    else if (!strcmp(argv[i], "--request") && (i + 1 < (size_t)argc))
+      {
+	/* ask the daemon to lock a VT */
+	if (daemon_request(atoi(argv[++i])))
+	  {
+	    perror("total-lockdown");
+	    return 1;
+	  }
+	return 0;
+      }
+    else
+      {
+	fprintf(stderr, "Usage: %s [--unicode] [--no-restore] [--daemon | --idle SECONDS | --request VT]\n", *argv);
+	return 1;
+      }
+  if (resident && idle)
+    {
+      fprintf(stderr, "%s: --daemon and --idle cannot be combined.\n", *argv);
+      return 1;
+    }
+  
+  /* verify that we are in a real VT, otherwise we cannot possibly lock it down */
+  tty = platform->ttyname(STDIN_FILENO);
+  if (!resident && !idle && ((tty == NULL) || (strstr(tty, "/dev/tty") != tty))) /* the daemon opens it on request */
+    {
+      fprintf(stderr, "A Linux console is required (as stdin).\n");
+      return 1;
+    }
   
-  passphrase = passphrase_read();
-  passphrase_crypt = crypt(passphrase, encrypted);
-  memset(passphrase, 0, strlen(passphrase)); /* wipe it! */
-  free(passphrase);
+  /* start recording unlock attempts, the lock works without it */
+  audit_start();
   
-  if (passphrase_crypt == NULL)
+  /* the daemon's socket must be bound while we have privileges, so that only root can connect */
+  if (resident && ((listener = daemon_listen()) < 0))
     {
-      /* This should not happen */
       perror("total-lockdown");
-      sleep(5);
-      return 2;
+      return 1;
+    }
+  
+  /* the input devices are only accessible with privileges */
+  if (idle && idle_open())
+    {
+      perror("total-lockdown");
+      return 1;
+    }
+  
+  /* the screen memory is only accessible with privileges, if it cannot be opened we just clear on unlock */
+  if (restore_screen && !resident && !idle)
+    screen_open(tty);
+  
+  /* the kernel decodes the keyboard, or we decode it with the console's layout, the daemon
+   * and the idle lock have no console yet, but the keymap is the same on all of them */
+  if (!unicode)
+    {
+      fd = (resident || idle) ? open("/dev/tty0", O_RDONLY | O_NOCTTY | O_CLOEXEC) : STDIN_FILENO;
+      console = load_layouts(fd);
+      if ((fd >= 0) && (fd != STDIN_FILENO))
+	close(fd);
+    }
+  
+  /* get the real user's encrypted passphrase, the daemon and the idle lock
+   * are unlocked by the owner of the locked VT instead, who is looked up then */
+  if (resident || idle)
+    {
+      seteuid(getuid());
+      setegid(getgid());
     }
+  else if ((identity = identify(getuid())) == NULL)
+    return 2;
+  
+  /* pick up passphrase changes while we are running, without it they require a restart */
+  refresh_start();
+  
+  if (resident)
+    {
+      /* everything is prepared, and identities are remembered, lock immediately on request */
+      memset(&action, 0, sizeof(action));
+      action.sa_handler = reap;
+      action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+      sigemptyset(&(action.sa_mask));
+      sigaction(SIGCHLD, &action, NULL);
+      sigemptyset(&children);
+      sigaddset(&children, SIGCHLD);
+      fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+      for (;;)
+	{
+	  if ((connection = next_request(listener, &vt)) < 0)
+	    {
+	      if ((errno == EAGAIN) || (errno == EINTR))
+		continue;
+	      perror("total-lockdown");
+	      return 1;
+	    }
+	  /* the lock is noticed as soon as it has been forked, so that it cannot
+	   * exit unnoticed, and we do not start another while it runs, the console
+	   * shows the lock, whichever VT was requested, the requester is answered
+	   * once the lock is engaged, as is anyone who requests it in the meantime */
+	  sigprocmask(SIG_BLOCK, &children, &mask);
+	  if (active_lock && engaged)
+	    send(connection, "locked\n", 7, MSG_NOSIGNAL | MSG_DONTWAIT);
+	  else if (active_lock && (waiting_count < MAX_WAITING))
+	    waiting[waiting_count++] = connection, connection = -1;
+	  else if (active_lock)
+	    ; /* too many are waiting, hang up */
+	  else if ((identity = owner(vt)) == NULL)
+	    ; /* nobody could unlock it, hang up */
+	  else if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) == 0)
+	    {
+	      /* the previous lock may have ended before we heard from it */
+	      if (engaged_fd >= 0)
+		close(engaged_fd);
+	      engaged = 0;
+	      answer();
+	      if ((pid = fork()) == 0)
+		{
+		  sigprocmask(SIG_SETMASK, &mask, NULL);
+		  close(listener);
+		  close(connection);
+		  close(pair[0]);
+		  _exit(serve(vt, pair[1], identity, unicode));
+		}
+	      close(pair[1]);
+	      engaged_fd = pid > 0 ? pair[0] : -1;
+	      if (pid > 0)
+		{
+		  active_lock = pid;
+		  waiting[waiting_count++] = connection, connection = -1;
+		}
+	      else
+		close(pair[0]);
+	    }
+	  sigprocmask(SIG_SETMASK, &mask, NULL);
+	  if (connection >= 0)
+	    close(connection);
+	}
+    }
+  
+  if (idle)
+    /* lock each time the user has been idle long enough, until the lock fails,
+     * the user may be on any VT, so we lock the one that is shown, as the daemon does */
+    do
+      {
+	if (idle_wait((unsigned int)idle))
+	  {
+	    perror("total-lockdown");
+	    rc = 1;
+	    break;
+	  }
+#ifdef DEBUG
+	idle_report();
+#endif
+	seteuid(0);
+	vt = vt_active();
+	seteuid(getuid());
+	if (vt < 0)
+	  {
+	    perror("total-lockdown");
+	    rc = 1;
+	    break;
+	  }
+	if ((identity = owner(vt)) == NULL)
+	  {
+	    rc = 2;
+	    break;
+	  }
+	if ((pid = fork()) == 0)
+	  _exit(serve(vt, -1, identity, unicode));
+	while ((pid > 0) && (waitpid(pid, &rc, 0) < 0))
+	  if (errno != EINTR)
+	    pid = -1;
+	if (pid < 0)
+	  {
+	    perror("total-lockdown");
+	    rc = 1;
+	    break;
+	  }
+	rc = WIFEXITED(rc) ? WEXITSTATUS(rc) : 1;
+      }
+    while (rc == 0);
+  else
+    rc = engage(identity->name, identity->encrypted, 1, unicode, restore_screen, -1);
   
-  if (!strcmp(passphrase_crypt, encrypted))
-    return 0;
+  keymap_unload(console);
   
-  sleep(3);
-  return 1;
+  return rc;
 }
 
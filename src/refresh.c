@@ -0,0 +1,289 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "refresh.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+
+#include "security.h"
+
+
+
+/**
+ * The longest encrypted passphrase that is supported
+ */
+#define MAX_ENCRYPTED  512
+
+/**
+ * How many times to try to read the shared slot before
+ * giving up and keeping the passphrase we already have
+ */
+#define MAX_TRIES  1000
+
+/**
+ * What is published when the passphrase cannot be resolved,
+ * it marks a locked account in the shadow database, so no
+ * passphrase matches it
+ */
+#define REVOKED  "!"
+
+
+
+/**
+ * The latest encrypted passphrase, shared between
+ * the lock and the refresher
+ */
+struct refresh_slot
+{
+  /**
+   * Odd while `encrypted` is being written
+   */
+  volatile unsigned long sequence;
+  
+  /**
+   * The number of times `encrypted` has been written
+   */
+  volatile unsigned long generation;
+  
+  /**
+   * The encrypted passphrase
+   */
+  char encrypted[MAX_ENCRYPTED];
+};
+
+
+
+/**
+ * The shared slot, `NULL` if the refresher is not running
+ */
+static struct refresh_slot* slot = NULL;
+
+/**
+ * The lock's copy of the latest encrypted passphrase
+ */
+static char current[MAX_ENCRYPTED];
+
+/**
+ * The generation of `current`
+ */
+static unsigned long current_generation = 0;
+
+
+
+/**
+ * Publish an encrypted passphrase to the lock
+ * 
+ * @param  encrypted  The encrypted passphrase
+ * @param  n          The size of `encrypted`, including the
+ *                    NUL, at most `MAX_ENCRYPTED`
+ */
+static void publish(const char* encrypted, size_t n)
+{
+  slot->sequence++;
+  __sync_synchronize();
+  memcpy(slot->encrypted, encrypted, n);
+  __sync_synchronize();
+  slot->sequence++;
+  slot->generation++;
+}
+
+
+/**
+ * Resolve the real user's encrypted passphrase again and
+ * publish it, if it cannot be resolved, because the user
+ * may no longer unlock, the old passphrase is revoked
+ * rather than kept, until it can be resolved again
+ */
+static void resolve(void)
+{
+  char* encrypted;
+  size_t n;
+  
+  seteuid(0); /* getcrypt drops it again */
+  encrypted = getcrypt(getuid());
+  if (encrypted == NULL)
+    {
+      publish(REVOKED, sizeof(REVOKED));
+      syslog(LOG_WARNING, "credentials changed but could not be resolved, no passphrase is accepted until they can be");
+      return;
+    }
+  if ((n = strlen(encrypted) + 1) > MAX_ENCRYPTED)
+    {
+      publish(REVOKED, sizeof(REVOKED));
+      syslog(LOG_WARNING, "credentials changed but the new passphrase hash is too long, no passphrase is accepted");
+      return;
+    }
+  
+  publish(encrypted, n);
+  syslog(LOG_NOTICE, "credentials changed, the passphrase has been refreshed");
+}
+
+
+/**
+ * The refresher process, waits for changes to the databases
+ * 
+ * @param  inotify  Watch for /etc
+ * @param  alive    The read end of the pipe that is closed when the lock ends
+ */
+static void __attribute__((noreturn)) refresher(int inotify, int alive)
+{
+  char buffer[sizeof(struct inotify_event) + NAME_MAX + 1] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct pollfd fds[2];
+  struct inotify_event* event;
+  int changed, null;
+  ssize_t got;
+  size_t i;
+  
+  /* getcrypt prints errors, they must not appear on the lock screen */
+  if ((null = open("/dev/null", O_WRONLY)) >= 0)
+    dup2(null, STDERR_FILENO);
+  close(STDIN_FILENO);
+  openlog("total-lockdown", LOG_PID, LOG_AUTHPRIV);
+  
+  fds[0].fd = inotify, fds[0].events = POLLIN;
+  fds[1].fd = alive, fds[1].events = POLLIN;
+  for (;;)
+    {
+      if (poll(fds, 2, -1) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  break;
+	}
+      if (fds[1].revents)
+	break;
+      
+      changed = 0;
+      while ((got = read(inotify, buffer, sizeof(buffer))) > 0)
+	for (i = 0; i < (size_t)got; i += sizeof(struct inotify_event) + event->len)
+	  {
+	    event = (struct inotify_event*)(buffer + i);
+	    if (event->len)
+	      changed |= !strcmp(event->name, "shadow") || !strcmp(event->name, "passwd") || !strcmp(event->name, "group");
+	  }
+      if (changed)
+	resolve();
+    }
+  
+  _exit(0);
+}
+
+
+/**
+ * Start a process that watches the user, group and shadow
+ * databases, and resolves the real user's encrypted
+ * passphrase again whenever they are changed, it exits
+ * when this process and all its children have exited
+ * 
+ * @return  Zero on success, -1 on error
+ */
+int refresh_start(void)
+{
+  int fds_pipe[2];
+  int inotify;
+  pid_t pid;
+  void* shared;
+  
+  /* the databases are replaced by renaming, so we watch the directory */
+  if ((inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+    return -1;
+  if (inotify_add_watch(inotify, "/etc", IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    goto fail;
+  
+  shared = mmap(NULL, sizeof(struct refresh_slot), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED)
+    goto fail;
+  if (pipe(fds_pipe))
+    goto fail_unmap;
+  
+  if ((pid = fork()) == (pid_t)-1)
+    {
+      close(fds_pipe[0]);
+      close(fds_pipe[1]);
+      goto fail_unmap;
+    }
+  
+  slot = shared;
+  if (pid == 0)
+    {
+      close(fds_pipe[1]);
+      refresher(inotify, fds_pipe[0]);
+    }
+  
+  close(inotify);
+  close(fds_pipe[0]); /* the write end is kept open until we exit */
+  return 0;
+  
+ fail_unmap:
+  munmap(shared, sizeof(struct refresh_slot));
+ fail:
+  close(inotify);
+  return -1;
+}
+
+
+/**
+ * Get the latest encrypted passphrase, this does not
+ * perform any lookup, it only copies it if it has changed,
+ * and it does not wait for the refresher to finish writing
+ * 
+ * @return  The latest encrypted passphrase, `NULL` if
+ *          it has not been changed since the lock started,
+ *          or if it is being changed right now, "!", which
+ *          no passphrase matches, if it could not be resolved
+ */
+const char* refresh_get(void)
+{
+  char copy[MAX_ENCRYPTED];
+  unsigned long sequence, generation;
+  int tries;
+  
+  if ((slot == NULL) || ((generation = slot->generation) == current_generation))
+    return current_generation ? current : NULL;
+  
+  for (tries = 0; tries < MAX_TRIES; tries++)
+    {
+      if ((sequence = slot->sequence) & 1)
+	continue;
+      __sync_synchronize();
+      generation = slot->generation;
+      memcpy(copy, slot->encrypted, MAX_ENCRYPTED);
+      __sync_synchronize();
+      if (sequence != slot->sequence)
+	continue;
+      memcpy(current, copy, MAX_ENCRYPTED);
+      current[MAX_ENCRYPTED - 1] = '\0';
+      current_generation = generation;
+      return current;
+    }
+  
+  /* the refresher is still writing, or died while writing, keep what we have */
+  return current_generation ? current : NULL;
+}
+
@@ -0,0 +1,48 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_REFRESH_H
+#define TOTAL_LOCKDOWN_REFRESH_H
+
+
+
+/**
+ * Start a process that watches the user, group and shadow
+ * databases, and resolves the real user's encrypted
+ * passphrase again whenever they are changed, it exits
+ * when this process and all its children have exited
+ * 
+ * @return  Zero on success, -1 on error
+ */
+int refresh_start(void);
+
+
+/**
+ * Get the latest encrypted passphrase, this does not
+ * perform any lookup, it only copies it if it has changed,
+ * and it does not wait for the refresher to finish writing
+ * 
+ * @return  The latest encrypted passphrase, `NULL` if
+ *          it has not been changed since the lock started,
+ *          or if it is being changed right now, "!", which
+ *          no passphrase matches, if it could not be resolved
+ */
+const char* refresh_get(void);
+
+
+#endif
+
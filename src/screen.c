@@ -0,0 +1,136 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "screen.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+
+
+
+/**
+ * File descriptor for the VT's screen memory, -1 if not opened
+ */
+static int vcsa_fd = -1;
+
+/**
+ * The snapshot, `NULL` if nothing is saved
+ */
+static unsigned char* snapshot = NULL;
+
+/**
+ * The size of the snapshot
+ */
+static size_t snapshot_size = 0;
+
+
+
+/**
+ * Open the VT's screen memory, /dev/vcsaN, this must
+ * be done before privileges are dropped
+ * 
+ * @param   tty  The VT's device, e.g. /dev/tty1
+ * @return       Zero on success, -1 on error
+ */
+int screen_open(const char* tty)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/dev/vcsa%s", tty + strlen("/dev/tty"));
+  vcsa_fd = open(path, O_RDWR | O_CLOEXEC);
+  return vcsa_fd < 0 ? -1 : 0;
+}
+
+
+/**
+ * Save the contents and cursor position of the VT into
+ * a locked memory that is not dumped and not inherited
+ * by child processes
+ * 
+ * @return  Zero on success, -1 on error
+ */
+int screen_save(void)
+{
+  unsigned char header[4]; /* lines, columns, cursor column, cursor line */
+  ssize_t got;
+  void* mem;
+  
+  if (vcsa_fd < 0)
+    return -1;
+  
+  if (pread(vcsa_fd, header, sizeof(header), 0) != (ssize_t)sizeof(header))
+    return -1;
+  
+  snapshot_size = sizeof(header) + 2 * (size_t)header[0] * (size_t)header[1];
+  mem = mmap(NULL, snapshot_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+    return -1;
+  snapshot = mem;
+  
+  /* keep the screen contents out of swap, core dumps and child processes */
+  prctl(PR_SET_DUMPABLE, 0);
+  if (mlock(snapshot, snapshot_size) ||
+      madvise(snapshot, snapshot_size, MADV_DONTDUMP) ||
+      madvise(snapshot, snapshot_size, MADV_DONTFORK))
+    goto fail;
+  
+  /* the screen may have been resized between the reads, in that case
+   * the snapshot is incomplete and restoring it would garble the screen */
+  got = pread(vcsa_fd, snapshot, snapshot_size, 0);
+  if ((got != (ssize_t)snapshot_size) || memcmp(snapshot, header, 2))
+    goto fail;
+  
+  return 0;
+  
+ fail:
+  explicit_bzero(snapshot, snapshot_size);
+  munmap(snapshot, snapshot_size);
+  snapshot = NULL;
+  return -1;
+}
+
+
+/**
+ * Restore the saved contents and cursor position of
+ * the VT and wipe the snapshot
+ * 
+ * @return  Zero on success, -1 on error or if nothing was saved,
+ *          in either case the snapshot has been wiped
+ */
+int screen_restore(void)
+{
+  int rc = -1;
+  
+  if (snapshot == NULL)
+    return -1;
+  
+  if (pwrite(vcsa_fd, snapshot, snapshot_size, 0) == (ssize_t)snapshot_size)
+    rc = 0;
+  
+  explicit_bzero(snapshot, snapshot_size); /* wipe it! */
+  munlock(snapshot, snapshot_size);
+  munmap(snapshot, snapshot_size);
+  snapshot = NULL;
+  
+  return rc;
+}
+
@@ -0,0 +1,54 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_SCREEN_H
+#define TOTAL_LOCKDOWN_SCREEN_H
+
+
+
+/**
+ * Open the VT's screen memory, /dev/vcsaN, this must
+ * be done before privileges are dropped
+ * 
+ * @param   tty  The VT's device, e.g. /dev/tty1
+ * @return       Zero on success, -1 on error
+ */
+int screen_open(const char* tty);
+
+
+/**
+ * Save the contents and cursor position of the VT into
+ * a locked memory that is not dumped and not inherited
+ * by child processes
+ * 
+ * @return  Zero on success, -1 on error
+ */
+int screen_save(void);
+
+
+/**
+ * Restore the saved contents and cursor position of
+ * the VT and wipe the snapshot
+ * 
+ * @return  Zero on success, -1 on error or if nothing was saved,
+ *          in either case the snapshot has been wiped
+ */
+int screen_restore(void);
+
+
+#endif
+
@@ -42,12 +42,15 @@
 
 
 /**
- * Get the real user's password entry in /etc/shadow or /etc/passwd,
+ * Get a user's password entry in /etc/shadow or /etc/passwd,
  * also do some privilege checks
  * 
- * @return  The real user's password encrypted
+ * @param   uid  The user, normally the real user, for any other user
+ *               the process's groups are not considered, only the
+ *               user's groups in the group database
+ * @return       The user's password encrypted
  */
-char* getcrypt(void)
+char* getcrypt(uid_t uid)
 {
 #ifdef HAVE_SHADOW
   struct spwd* spwd;
@@ -58,7 +61,7 @@ char* getcrypt(void)
   char* crypted;
   
   /* get information about the user */
-  pwd = getpwuid(getuid());
+  pwd = getpwuid(uid);
   if ((pwd == NULL) || ((name = pwd->pw_name) == NULL))
     {
       fprintf(stderr, "You do not exist, go away!\n");
@@ -75,8 +78,12 @@ char* getcrypt(void)
     {
       gid_t lockdown_gid = grp->gr_gid;
       char** lockdown_members = grp->gr_mem;
-      int authed = lockdown_gid == getgid(); /* test primary herd (does not really belong here, but anyway) */
-      authed |= lockdown_gid == getegid(); /* do not care if setgid it used the herd is set to lockdown */
+      int authed = lockdown_gid == pwd->pw_gid; /* test primary herd (does not really belong here, but anyway) */
+      if (uid == getuid())
+	{
+	  authed |= lockdown_gid == getgid();
+	  authed |= lockdown_gid == getegid(); /* do not care if setgid it used the herd is set to lockdown */
+	}
       
       /* check members of the herd, the user might have been give access to it while logged in */
       if (authed == 0)
@@ -102,16 +109,29 @@ char* getcrypt(void)
 	      perror("total-lockdown");
 	      return NULL;
 	    }
-	  groups_n = getgroups((int)groups_max, groups);
+	  if (uid == getuid())
+	    groups_n = getgroups((int)groups_max, groups);
+	  else
+	    {
+	      /* not our own user, so we only have the group database */
+	      groups_n = (int)groups_max;
+	      if (getgrouplist(name, pwd->pw_gid, groups, &groups_n) < 0)
+		{
+		  groups_n = -1;
+		  errno = ERANGE;
+		}
+	    }
 	  if (groups_n < 0)
 	    {
 	      perror("total-lockdown");
+	      free(groups);
 	      return NULL;
 	    }
 	  
 	  for (i = 0; i < groups_n; i++)
 	    if ((authed = (*(groups + i) == lockdown_gid)))
 	      break;
+	  free(groups);
 	}
       
       if (authed == 0)
@@ -170,14 +190,18 @@ char* getcrypt(void)
 
 
 /**
- * get the real user's real name and fall back to username
+ * get a user's real name and fall back to username
  * 
- * @return  The real user's name
+ * @param   uid  The user
+ * @return       The user's name, `NULL` if unknown
  */
-char* getname(void)
+char* getname(uid_t uid)
 {
-  struct passwd* pwd = getpwuid(getuid());
-  char* name = pwd->pw_gecos ? pwd->pw_gecos : pwd->pw_name;
+  struct passwd* pwd = getpwuid(uid);
+  char* name;
+  if (pwd == NULL)
+    return NULL;
+  name = pwd->pw_gecos ? pwd->pw_gecos : pwd->pw_name;
   if (name)
     {
       *(strchrnul(name, ',')) = '\0';
@@ -19,25 +19,30 @@
 #define TOTAL_LOCKDOWN_SECURITY_H
 
 
+#include <sys/types.h>
 #include <pwd.h>
 #include <grp.h>
 
 
 /**
- * Get the real user's password entry in /etc/shadow or /etc/passwd,
+ * Get a user's password entry in /etc/shadow or /etc/passwd,
  * also do some privilege checks
  * 
- * @return  The real user's password encrypted
+ * @param   uid  The user, normally the real user, for any other user
+ *               the process's groups are not considered, only the
+ *               user's groups in the group database
+ * @return       The user's password encrypted
  */
-char* getcrypt(void);
+char* getcrypt(uid_t uid);
 
 
 /**
- * get the real user's real name and fall back to username
+ * get a user's real name and fall back to username
  * 
- * @return  The real user's name
+ * @param   uid  The user
+ * @return       The user's name, `NULL` if unknown
  */
-char* getname(void);
+char* getname(uid_t uid);
 
 
 #endif
@@ -0,0 +1,368 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "simulation.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <linux/kd.h>
+
+
+
+/**
+ * The maximum number of spawned processes that have not been waited for
+ */
+#define MAX_PENDING  8
+
+
+
+/**
+ * A spawned process that has not been waited for
+ */
+struct process
+{
+  /**
+   * The process ID, zero if the slot is unused
+   */
+  pid_t pid;
+  
+  /**
+   * The function the process runs
+   */
+  int (*function)(const void* arg);
+  
+  /**
+   * Argument for `function`
+   */
+  const void* arg;
+  
+  /**
+   * The signal the process has been killed with, zero if none
+   */
+  int signo;
+};
+
+
+
+/**
+ * The simulated console
+ */
+static struct simulation* sim = NULL;
+
+/**
+ * Spawned processes that have not been waited for, indexed
+ * by the process ID modulo `MAX_PENDING`
+ */
+static struct process pending[MAX_PENDING];
+
+/**
+ * The pathname of the simulated console
+ */
+static char sim_tty[] = "/dev/tty63";
+
+
+
+/**
+ * Get the pathname of the simulated console
+ * 
+ * @param   fd  Ignored
+ * @return      The pathname
+ */
+static char* sim_ttyname(int fd)
+{
+  (void) fd;
+  return sim_tty;
+}
+
+
+/**
+ * Get the simulated console's terminal attributes
+ * 
+ * @param   fd    Ignored
+ * @param   attr  Output parameter for the attributes
+ * @return        Zero
+ */
+static int sim_tcgetattr(int fd, struct termios* attr)
+{
+  (void) fd;
+  *attr = sim->attr;
+  return 0;
+}
+
+
+/**
+ * Set the simulated console's terminal attributes
+ * 
+ * @param   fd      Ignored
+ * @param   action  Ignored
+ * @param   attr    The attributes
+ * @return          Zero
+ */
+static int sim_tcsetattr(int fd, int action, const struct termios* attr)
+{
+  (void) fd;
+  (void) action;
+  sim->attr = *attr;
+  return 0;
+}
+
+
+/**
+ * Get the simulated console's keyboard mode
+ * 
+ * @param   fd    Ignored
+ * @param   mode  Output parameter for the mode
+ * @return        Zero
+ */
+static int sim_getkbmode(int fd, int* mode)
+{
+  (void) fd;
+  *mode = sim->kbmode;
+  return 0;
+}
+
+
+/**
+ * Set the simulated console's keyboard mode
+ * 
+ * @param   fd    Ignored
+ * @param   mode  The mode
+ * @return        Zero
+ */
+static int sim_setkbmode(int fd, int mode)
+{
+  (void) fd;
+  sim->kbmode = mode;
+  return 0;
+}
+
+
+/**
+ * Read the next keystroke from the script
+ * 
+ * @param   fd   Ignored
+ * @param   buf  Output buffer
+ * @param   n    The size of `buf`
+ * @return       1, or 0 when the script has ended
+ */
+static ssize_t sim_read(int fd, void* buf, size_t n)
+{
+  (void) fd;
+  sim->reads++;
+  if ((n == 0) || (sim->input_ptr == sim->input_length))
+    return 0;
+  *(uint8_t*)buf = sim->input[sim->input_ptr++];
+  return 1;
+}
+
+
+/**
+ * Discard a text printed on the lock screen
+ * 
+ * @param  text  The text
+ */
+static void sim_print(const char* text)
+{
+  sim->printed += strlen(text);
+}
+
+
+/**
+ * Spawn a process, it is run when it is waited for
+ * 
+ * @param   function  The function the process runs
+ * @param   arg       Argument for `function`
+ * @return            The process ID
+ */
+static pid_t sim_spawn(int (*function)(const void* arg), const void* arg)
+{
+  pid_t pid = (pid_t)++(sim->spawned);
+  struct process* process = pending + (size_t)pid % MAX_PENDING;
+  process->pid = pid;
+  process->function = function;
+  process->arg = arg;
+  process->signo = 0;
+  return pid;
+}
+
+
+/**
+ * Kill a spawned process, it will not be run
+ * 
+ * @param   pid    The process ID
+ * @param   signo  The signal
+ * @return         0, -1 if there is no such process
+ */
+static int sim_kill(pid_t pid, int signo)
+{
+  struct process* process = pending + (size_t)pid % MAX_PENDING;
+  if (process->pid != pid)
+    {
+      errno = ESRCH;
+      return -1;
+    }
+  process->signo = signo;
+  return 0;
+}
+
+
+/**
+ * Run a spawned process to completion, unless it has been killed
+ * 
+ * @param   pid     The process ID
+ * @param   status  Output parameter for the status
+ * @return          `pid`, -1 if there is no such process
+ */
+static pid_t sim_wait(pid_t pid, int* status)
+{
+  struct process process = pending[(size_t)pid % MAX_PENDING];
+  if (process.pid != pid)
+    {
+      errno = ECHILD;
+      return -1;
+    }
+  pending[(size_t)pid % MAX_PENDING].pid = 0;
+  if (process.signo)
+    *status = process.signo & 127;
+  else
+    *status = (process.function(process.arg) & 255) << 8;
+  return pid;
+}
+
+
+/**
+ * Read a passphrase from a pipe
+ * 
+ * @param   fd  The read end of the pipe
+ * @return      The passphrase, without the terminating LF
+ */
+static char* sim_readpass(int fd)
+{
+  size_t size = 64, ptr = 0;
+  char* passphrase = malloc(size);
+  char* new;
+  ssize_t got;
+  
+  if (passphrase == NULL)
+    abort();
+  for (;;)
+    {
+      if (ptr == size)
+	{
+	  if ((new = realloc(passphrase, size <<= 1)) == NULL)
+	    abort();
+	  passphrase = new;
+	}
+      got = read(fd, passphrase + ptr, 1);
+      if ((got <= 0) || (passphrase[ptr] == '\n'))
+	break;
+      ptr++;
+    }
+  passphrase[ptr] = '\0';
+  return passphrase;
+}
+
+
+/**
+ * Skip time, rather than sleeping
+ * 
+ * @param   seconds  The number of seconds to skip
+ * @return           Zero
+ */
+static unsigned int sim_sleep(unsigned int seconds)
+{
+  sim->clock.tv_sec += (time_t)seconds;
+  return 0;
+}
+
+
+/**
+ * Get the monotonic time, including the skipped time
+ * 
+ * @param  time  Output parameter for the time
+ */
+static void sim_now(struct timespec* time)
+{
+  clock_gettime(CLOCK_MONOTONIC, time);
+  time->tv_sec += sim->clock.tv_sec;
+  time->tv_nsec += sim->clock.tv_nsec;
+  if (time->tv_nsec >= 1000000000L)
+    {
+      time->tv_sec += 1;
+      time->tv_nsec -= 1000000000L;
+    }
+}
+
+
+
+/**
+ * The simulated operating system
+ */
+const struct platform platform_simulated =
+  {
+    .ttyname   = sim_ttyname,
+    .tcgetattr = sim_tcgetattr,
+    .tcsetattr = sim_tcsetattr,
+    .getkbmode = sim_getkbmode,
+    .setkbmode = sim_setkbmode,
+    .read      = sim_read,
+    .print     = sim_print,
+    .spawn     = sim_spawn,
+    .wait      = sim_wait,
+    .kill      = sim_kill,
+    .readpass  = sim_readpass,
+    .sleep     = sim_sleep,
+    .now       = sim_now
+  };
+
+
+/**
+ * Reset a simulated console and make the lock run against it
+ * 
+ * @param  simulation  The simulated console
+ * @param  input       Scripted medium raw scancodes, or UTF-8 text
+ *                     if the lock runs in Unicode mode
+ * @param  n           The number of bytes in `input`
+ */
+void simulation_start(struct simulation* simulation, const uint8_t* input, size_t n)
+{
+  memset(simulation, 0, sizeof(*simulation));
+  memset(pending, 0, sizeof(pending));
+  simulation->input = input;
+  simulation->input_length = n;
+  simulation->attr.c_iflag = ICRNL | IXON;
+  simulation->attr.c_oflag = OPOST | ONLCR;
+  simulation->attr.c_cflag = CREAD | CS8;
+  simulation->attr.c_lflag = ISIG | ICANON | ECHO | ECHOE | ECHOK | IEXTEN;
+  simulation->kbmode = K_XLATE;
+  sim = simulation;
+  platform = &platform_simulated;
+}
+
+
+/**
+ * Make the lock run against the real operating system again
+ */
+void simulation_stop(void)
+{
+  platform = &platform_native;
+  sim = NULL;
+}
+
@@ -0,0 +1,109 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_SIMULATION_H
+#define TOTAL_LOCKDOWN_SIMULATION_H
+
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <termios.h>
+#include <time.h>
+
+#include "platform.h"
+
+
+
+/**
+ * A simulated console, the lock runs in-process against it,
+ * with spawned processes run inline when they are waited for
+ */
+struct simulation
+{
+  /**
+   * Scripted keyboard input, one byte is read at a time
+   */
+  const uint8_t* input;
+  
+  /**
+   * The number of bytes in `input`
+   */
+  size_t input_length;
+  
+  /**
+   * The number of bytes in `input` that have been read
+   */
+  size_t input_ptr;
+  
+  /**
+   * The console's terminal attributes
+   */
+  struct termios attr;
+  
+  /**
+   * The console's keyboard mode
+   */
+  int kbmode;
+  
+  /**
+   * The time the lock has slept, sleeping skips the time rather
+   * than waiting, `platform->now` is the monotonic clock plus this
+   */
+  struct timespec clock;
+  
+  /**
+   * The number of reads from the keyboard
+   */
+  unsigned long reads;
+  
+  /**
+   * The number of processes that have been spawned
+   */
+  unsigned long spawned;
+  
+  /**
+   * The number of bytes printed on the lock screen
+   */
+  size_t printed;
+};
+
+
+
+/**
+ * The simulated operating system
+ */
+extern const struct platform platform_simulated;
+
+
+/**
+ * Reset a simulated console and make the lock run against it
+ * 
+ * @param  simulation  The simulated console
+ * @param  input       Scripted medium raw scancodes, or UTF-8 text
+ *                     if the lock runs in Unicode mode
+ * @param  n           The number of bytes in `input`
+ */
+void simulation_start(struct simulation* simulation, const uint8_t* input, size_t n);
+
+/**
+ * Make the lock run against the real operating system again
+ */
+void simulation_stop(void);
+
+
+#endif
+
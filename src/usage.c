@@ -0,0 +1,227 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "usage.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+
+
+/**
+ * How deep the process tree is followed, the lock
+ * is at most a few processes deep
+ */
+#define MAX_DEPTH  8
+
+
+
+/**
+ * The usage when the accounting started
+ */
+static struct usage baseline;
+
+/**
+ * When the accounting started
+ */
+static struct timespec started;
+
+
+
+/**
+ * Read a small file
+ * 
+ * @param   pathname  The file
+ * @param   buf       Output buffer, it will be NUL-terminated
+ * @param   size      The size of `buf`
+ * @return            The number of read bytes, -1 on error
+ */
+static ssize_t read_file(const char* pathname, char* buf, size_t size)
+{
+  ssize_t got;
+  int fd;
+  if ((fd = open(pathname, O_RDONLY | O_CLOEXEC)) < 0)
+    return -1;
+  got = read(fd, buf, size - 1);
+  close(fd);
+  buf[got < 0 ? 0 : got] = '\0';
+  return got;
+}
+
+
+/**
+ * Add the usage of this process or of its waited for descendants
+ * 
+ * @param  usage  The sum to add to
+ * @param  who    `RUSAGE_SELF` or `RUSAGE_CHILDREN`
+ */
+static void add_rusage(struct usage* usage, int who)
+{
+  struct rusage rusage;
+  if (getrusage(who, &rusage))
+    return;
+  usage->wakeups += (unsigned long)(rusage.ru_nvcsw);
+  usage->preemptions += (unsigned long)(rusage.ru_nivcsw);
+  usage->cpu += (unsigned long long)(rusage.ru_utime.tv_sec + rusage.ru_stime.tv_sec) * 1000000ULL;
+  usage->cpu += (unsigned long long)(rusage.ru_utime.tv_usec + rusage.ru_stime.tv_usec);
+}
+
+
+/**
+ * Add the usage of a running process, excluding
+ * descendants that it has not waited for
+ * 
+ * @param  usage  The sum to add to
+ * @param  pid    The process
+ */
+static void add_process(struct usage* usage, pid_t pid)
+{
+  static long ticks = 0;
+  char pathname[64];
+  char buf[4096];
+  unsigned long utime, stime, cutime, cstime, switches;
+  char* field;
+  
+  if (ticks == 0)
+    ticks = sysconf(_SC_CLK_TCK);
+  
+  /* the CPU time, including descendants it has waited for, the command
+   * name is parenthesised and may contain anything, so we skip past it */
+  sprintf(pathname, "/proc/%li/stat", (long)pid);
+  if ((read_file(pathname, buf, sizeof(buf)) > 0) && (field = strrchr(buf, ')')))
+    if (sscanf(field + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %lu %lu",
+	       &utime, &stime, &cutime, &cstime) == 4)
+      usage->cpu += (unsigned long long)(utime + stime + cutime + cstime) * 1000000ULL / (unsigned long long)ticks;
+  
+  sprintf(pathname, "/proc/%li/status", (long)pid);
+  if (read_file(pathname, buf, sizeof(buf)) > 0)
+    {
+      if ((field = strstr(buf, "\nvoluntary_ctxt_switches:")) && (sscanf(field + 25, "%lu", &switches) == 1))
+	usage->wakeups += switches;
+      if ((field = strstr(buf, "\nnonvoluntary_ctxt_switches:")) && (sscanf(field + 28, "%lu", &switches) == 1))
+	usage->preemptions += switches;
+    }
+}
+
+
+/**
+ * Add the usage of the running descendants of a process
+ * 
+ * @param  usage  The sum to add to
+ * @param  pid    The process
+ * @param  depth  The number of generations below this process
+ */
+static void add_children(struct usage* usage, pid_t pid, int depth)
+{
+  char pathname[64];
+  char children[1024];
+  char* p;
+  char* end;
+  long child;
+  
+  if (depth == MAX_DEPTH)
+    return;
+  
+  sprintf(pathname, "/proc/%li/task/%li/children", (long)pid, (long)pid);
+  if (read_file(pathname, children, sizeof(children)) <= 0)
+    return; /* no children, or not supported by the kernel */
+  
+  for (p = children; (child = strtol(p, &end, 10)) > 0; p = end)
+    {
+      add_process(usage, (pid_t)child);
+      add_children(usage, (pid_t)child, depth + 1);
+    }
+}
+
+
+/**
+ * Measure the usage of a running process and its running
+ * descendants, for example of a lock that another process runs
+ * 
+ * @param  pid    The process
+ * @param  usage  Output parameter for the usage
+ */
+void usage_measure(pid_t pid, struct usage* usage)
+{
+  memset(usage, 0, sizeof(*usage));
+  add_process(usage, pid);
+  add_children(usage, pid, 0);
+}
+
+
+/**
+ * Measure the usage of this process and all its descendants
+ * 
+ * @param  usage  Output parameter for the usage
+ */
+static void measure(struct usage* usage)
+{
+  memset(usage, 0, sizeof(*usage));
+  add_rusage(usage, RUSAGE_SELF);
+  add_rusage(usage, RUSAGE_CHILDREN);
+  add_children(usage, getpid(), 0);
+}
+
+
+/**
+ * Start accounting the resource usage of this process and
+ * all its descendants, this is the baseline for `usage_report`
+ */
+void usage_start(void)
+{
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  measure(&baseline);
+}
+
+
+/**
+ * Log the wakeups, preemptions and CPU time of this process
+ * and all its descendants since `usage_start` was called
+ * 
+ * Descendants that have not yet been waited for are read from
+ * /proc, descendants that have been waited for by a process that
+ * is still running only contribute their CPU time
+ * 
+ * @param  when  Description of the occasion, such as "at unlock"
+ */
+void usage_report(const char* when)
+{
+  struct usage usage;
+  struct timespec now;
+  unsigned long long cpu;
+  
+  measure(&usage);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  
+  /* descendants that exited without being waited for can make a counter appear to decrease */
+  cpu = usage.cpu > baseline.cpu ? usage.cpu - baseline.cpu : 0;
+  syslog(LOG_AUTHPRIV | LOG_INFO,
+	 "usage %s: locked for %lis, %lu wakeups, %lu preemptions, %llu.%06llus CPU",
+	 when, (long)(now.tv_sec - started.tv_sec),
+	 usage.wakeups > baseline.wakeups ? usage.wakeups - baseline.wakeups : 0,
+	 usage.preemptions > baseline.preemptions ? usage.preemptions - baseline.preemptions : 0,
+	 cpu / 1000000ULL, cpu % 1000000ULL);
+}
+
@@ -0,0 +1,81 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_USAGE_H
+#define TOTAL_LOCKDOWN_USAGE_H
+
+
+#include <sys/types.h>
+
+
+
+/**
+ * Resource usage of a process tree
+ */
+struct usage
+{
+  /**
+   * The number of voluntary context switches, that is, the number
+   * of times a process blocked and was woken up again
+   */
+  unsigned long wakeups;
+  
+  /**
+   * The number of involuntary context switches
+   */
+  unsigned long preemptions;
+  
+  /**
+   * The user and system CPU time, in microseconds
+   */
+  unsigned long long cpu;
+};
+
+
+
+
+/**
+ * Start accounting the resource usage of this process and
+ * all its descendants, this is the baseline for `usage_report`
+ */
+void usage_start(void);
+
+
+/**
+ * Log the wakeups, preemptions and CPU time of this process
+ * and all its descendants since `usage_start` was called
+ * 
+ * Descendants that have not yet been waited for are read from
+ * /proc, descendants that have been waited for by a process that
+ * is still running only contribute their CPU time
+ * 
+ * @param  when  Description of the occasion, such as "at unlock"
+ */
+void usage_report(const char* when);
+
+/**
+ * Measure the usage of a running process and its running
+ * descendants, for example of a lock that another process runs
+ * 
+ * @param  pid    The process
+ * @param  usage  Output parameter for the usage
+ */
+void usage_measure(pid_t pid, struct usage* usage);
+
+
+#endif
+
@@ -0,0 +1,126 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "vt.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/vt.h>
+
+
+
+/**
+ * Perform a VT ioctl on the console
+ * 
+ * @param   request  The ioctl request
+ * @param   arg      Argument for the request
+ * @return           Zero on success, -1 on error
+ */
+static int console_ioctl(unsigned long request, void* arg)
+{
+  int fd, rc, saved_errno;
+  if ((fd = open("/dev/tty0", O_WRONLY | O_NOCTTY | O_CLOEXEC)) < 0)
+    return -1;
+  rc = ioctl(fd, request, arg);
+  saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return rc < 0 ? -1 : 0;
+}
+
+
+/**
+ * Open an unused VT as the controlling terminal, the process must
+ * be a session leader without a controlling terminal, and have
+ * privileges to open the console
+ * 
+ * @param   vt  Output parameter for the VT's number
+ * @return      File descriptor for the VT, -1 on error
+ */
+int vt_open(int* vt)
+{
+  char tty[sizeof("/dev/tty") + 3 * sizeof(int)];
+  int fd;
+  
+  if (console_ioctl(VT_OPENQRY, vt))
+    return -1;
+  if (*vt < 1)
+    {
+      errno = EBUSY; /* every VT is in use */
+      return -1;
+    }
+  
+  /* the keyboard mode can only be changed, without CAP_SYS_TTY_CONFIG,
+   * on the controlling terminal, opening it makes it ours, but be sure */
+  sprintf(tty, "/dev/tty%i", *vt);
+  if ((fd = open(tty, O_RDWR)) < 0)
+    return -1;
+  if (ioctl(fd, TIOCSCTTY, 0) < 0)
+    {
+      close(fd);
+      return -1;
+    }
+  return fd;
+}
+
+
+/**
+ * Switch to a VT and wait until it is shown,
+ * this requires privileges
+ * 
+ * @param   vt  The VT's number
+ * @return      Zero on success, -1 on error
+ */
+int vt_switch(int vt)
+{
+  if (console_ioctl(VT_ACTIVATE, (void*)(long)vt))
+    return -1;
+  return console_ioctl(VT_WAITACTIVE, (void*)(long)vt);
+}
+
+
+/**
+ * Get the VT that is shown, this requires privileges
+ * 
+ * @return  The VT's number, -1 on error
+ */
+int vt_active(void)
+{
+  struct vt_stat state;
+  if (console_ioctl(VT_GETSTATE, &state))
+    return -1;
+  return (int)(state.v_active);
+}
+
+
+/**
+ * Deallocate a VT that is no longer used, it must
+ * not be shown or opened, this requires privileges
+ * 
+ * @param   vt  The VT's number
+ * @return      Zero on success, -1 on error
+ */
+int vt_release(int vt)
+{
+  return console_ioctl(VT_DISALLOCATE, (void*)(long)vt);
+}
+
@@ -0,0 +1,60 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_VT_H
+#define TOTAL_LOCKDOWN_VT_H
+
+
+
+/**
+ * Open an unused VT as the controlling terminal, the process must
+ * be a session leader without a controlling terminal, and have
+ * privileges to open the console
+ * 
+ * @param   vt  Output parameter for the VT's number
+ * @return      File descriptor for the VT, -1 on error
+ */
+int vt_open(int* vt);
+
+/**
+ * Switch to a VT and wait until it is shown,
+ * this requires privileges
+ * 
+ * @param   vt  The VT's number
+ * @return      Zero on success, -1 on error
+ */
+int vt_switch(int vt);
+
+/**
+ * Get the VT that is shown, this requires privileges
+ * 
+ * @return  The VT's number, -1 on error
+ */
+int vt_active(void);
+
+/**
+ * Deallocate a VT that is no longer used, it must
+ * not be shown or opened, this requires privileges
+ * 
+ * @param   vt  The VT's number
+ * @return      Zero on success, -1 on error
+ */
+int vt_release(int vt);
+
+
+#endif
+
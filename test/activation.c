@@ -0,0 +1,382 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "common.h"
+
+#include "daemon.h"
+#include "vt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <linux/kd.h>
+#include <linux/vt.h>
+
+
+
+/**
+ * Latencies of one way of locking
+ */
+struct sample
+{
+  /**
+   * The latencies, in nanoseconds
+   */
+  long long* latencies;
+  
+  /**
+   * The sum of `latencies`
+   */
+  long long total;
+};
+
+
+
+/**
+ * The scancodes that unlock the lock
+ */
+static uint8_t unlock[2 * sizeof(TEST_PASSPHRASE "\n")];
+
+/**
+ * The number of bytes in `unlock`
+ */
+static size_t unlock_length;
+
+
+
+/**
+ * Compare latencies, for qsort(3)
+ * 
+ * @param   a  One of the latencies
+ * @param   b  The other latency
+ * @return     Negative if `a` is shorter, positive if `b` is
+ *             shorter, zero if they are equal
+ */
+static int compare(const void* a, const void* b)
+{
+  long long x = *(const long long*)a, y = *(const long long*)b;
+  return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Print the latency distribution of a way of locking
+ * 
+ * @param  what    The way of locking
+ * @param  sample  Its latencies
+ * @param  n       The number of latencies
+ */
+static void report(const char* what, struct sample* sample, size_t n)
+{
+  qsort(sample->latencies, n, sizeof(*(sample->latencies)), compare);
+  printf("%s: mean %lld ns, p50 %lld ns, p99 %lld ns, max %lld ns\n", what, sample->total / (long long)n,
+	 sample->latencies[n / 2], sample->latencies[n * 99 / 100], sample->latencies[n - 1]);
+}
+
+
+/**
+ * Open a VT without making it the controlling terminal
+ * 
+ * @param   vt  The VT's number
+ * @return      File descriptor for the VT, -1 on error
+ */
+static int open_vt(int vt)
+{
+  char tty[sizeof("/dev/tty") + 3 * sizeof(int)];
+  sprintf(tty, "/dev/tty%i", vt);
+  return open(tty, O_RDWR | O_NOCTTY | O_CLOEXEC);
+}
+
+
+/**
+ * Type the passphrase on a VT, the lock reads it as if it came from the keyboard
+ * 
+ * @param   vt  The VT's number
+ * @return      Zero on success, -1 on error
+ */
+static int type(int vt)
+{
+  size_t i;
+  int fd;
+  if ((fd = open_vt(vt)) < 0)
+    return -1;
+  for (i = 0; i < unlock_length; i++)
+    if (ioctl(fd, TIOCSTI, unlock + i))
+      {
+	close(fd);
+	return -1;
+      }
+  close(fd);
+  return 0;
+}
+
+
+/**
+ * Check whether a lock started by the daemon is still running, or
+ * has not been reaped, the locks are the daemon's children that
+ * lead a session of their own, unlike the daemon's helpers
+ * 
+ * @param   daemon_pid  The daemon
+ * @return              Whether a lock is running
+ */
+static int lock_running(pid_t daemon_pid)
+{
+  char path[64];
+  long child, session;
+  int running = 0;
+  FILE* f;
+  FILE* stat;
+  
+  snprintf(path, sizeof(path), "/proc/%li/task/%li/children", (long)daemon_pid, (long)daemon_pid);
+  if ((f = fopen(path, "r")) == NULL)
+    return 0;
+  while (!running && (fscanf(f, "%li", &child) == 1))
+    {
+      snprintf(path, sizeof(path), "/proc/%li/stat", child);
+      if ((stat = fopen(path, "r")) == NULL)
+	continue;
+      /* the command name is in parentheses, and it cannot contain a parenthesis, since it is ours */
+      if (fscanf(stat, "%*d (%*[^)]) %*c %*d %*d %li", &session) == 1)
+	running = session == child;
+      fclose(stat);
+    }
+  fclose(f);
+  return running;
+}
+
+
+/**
+ * Wait until the daemon's lock has exited and been reaped
+ * 
+ * @param  daemon_pid  The daemon
+ */
+static void await_unlock(pid_t daemon_pid)
+{
+  struct timespec pause = { 0, 20000 };
+  while (lock_running(daemon_pid))
+    nanosleep(&pause, NULL);
+}
+
+
+/**
+ * Start the daemon, socket activated as by the service manager
+ * 
+ * @param   program   The program
+ * @param   listener  The listening socket
+ * @return            The daemon's process ID, -1 on error
+ */
+static pid_t start_daemon(const char* program, int listener)
+{
+  char pid[3 * sizeof(pid_t) + 2];
+  pid_t daemon_pid;
+  int null;
+  
+  if ((daemon_pid = fork()) != 0)
+    return daemon_pid;
+  if ((null = open("/dev/null", O_RDWR)) >= 0)
+    {
+      dup2(null, STDIN_FILENO);
+      dup2(null, STDOUT_FILENO);
+      dup2(null, STDERR_FILENO);
+    }
+  dup2(listener, 3);
+  sprintf(pid, "%li", (long)getpid());
+  setenv("LISTEN_PID", pid, 1);
+  setenv("LISTEN_FDS", "1", 1);
+  execl(program, program, "--daemon", NULL);
+  _exit(1);
+}
+
+
+/**
+ * Lock a fresh VT by starting the program, as from the command line,
+ * the program is run as if it was installed with setuid and started
+ * by a user that does not exist
+ * 
+ * @param   program  The program
+ * @param   user     The user
+ * @return           The time until the keyboard was grabbed, in
+ *                   nanoseconds, -1 on error
+ */
+static long long cold(const char* program, uid_t user)
+{
+  struct timespec start, end, pause = { 0, 20000 };
+  int fds[2], vt, fd, mode, status;
+  pid_t pid;
+  
+  if (pipe(fds) || ((pid = fork()) < 0))
+    return -1;
+  if (pid == 0)
+    {
+      close(fds[0]);
+      setsid();
+      if ((fd = vt_open(&vt)) < 0)
+	_exit(1);
+      dup2(fd, STDIN_FILENO);
+      dup2(fd, STDOUT_FILENO);
+      dup2(fd, STDERR_FILENO);
+      if (setresuid(user, 0, 0) || (write(fds[1], &vt, sizeof(vt)) != (ssize_t)sizeof(vt)))
+	_exit(1);
+      execl(program, program, NULL);
+      _exit(1);
+    }
+  close(fds[1]);
+  
+  /* the clock starts when the program is started */
+  if (read(fds[0], &vt, sizeof(vt)) != (ssize_t)sizeof(vt))
+    return close(fds[0]), waitpid(pid, NULL, 0), -1;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  close(fds[0]);
+  if ((fd = open_vt(vt)) < 0)
+    return kill(pid, SIGKILL), waitpid(pid, NULL, 0), -1;
+  while (!ioctl(fd, KDGKBMODE, &mode) && (mode != K_MEDIUMRAW))
+    nanosleep(&pause, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  
+  if (type(vt) || (waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) || WEXITSTATUS(status))
+    return close(fd), kill(pid, SIGKILL), waitpid(pid, NULL, 0), -1;
+  close(fd);
+  vt_release(vt);
+  return test_elapsed(&start, &end);
+}
+
+
+/**
+ * Compare the time from a request to the daemon until the keyboard is
+ * grabbed, with the time from starting the program until the keyboard is
+ * grabbed, the program is built for testing, so that it unlocks with the
+ * test passphrase, and runs on real VTs, which the test types on
+ * 
+ * @param   argc  The number of elements in `argv`
+ * @param   argv  The program name, the program to benchmark,
+ *                and optionally the number of rounds
+ * @return        0 on success, 1 on failure
+ */
+int main(int argc, char** argv)
+{
+  struct sample warm, cold_start;
+  struct timespec start, end;
+  struct vt_stat state;
+  struct stat attr;
+  size_t i, rounds;
+  pid_t daemon_pid;
+  uid_t user;
+  int console, listener, home, vt, fd, rc = 1;
+  
+  if ((argc < 2) || (argc > 3))
+    return fprintf(stderr, "Usage: %s PROGRAM [ROUNDS]\n", *argv), 1;
+  rounds = argc > 2 ? (size_t)atol(argv[2]) : 100;
+  rounds = rounds ? rounds : 1;
+  
+  if (geteuid())
+    {
+      printf("%s: skipped, the daemon only accepts requests from root\n", *argv);
+      return 0;
+    }
+  if (((console = open("/dev/tty0", O_RDONLY | O_NOCTTY | O_CLOEXEC)) < 0) || ioctl(console, VT_GETSTATE, &state))
+    {
+      printf("%s: skipped, there are no VTs\n", *argv);
+      return 0;
+    }
+  if ((user = test_unknown_user()) == 0)
+    return fprintf(stderr, "%s: every user ID is in use\n", *argv), 1;
+  home = state.v_active;
+  
+  warm.latencies = calloc(rounds, sizeof(long long));
+  cold_start.latencies = calloc(rounds, sizeof(long long));
+  if (!warm.latencies || !cold_start.latencies)
+    return perror(*argv), 1;
+  warm.total = cold_start.total = 0;
+  unlock_length = test_type(TEST_PASSPHRASE "\n", unlock);
+  
+  /* the VT to lock, it belongs to the user, who is logged in on it */
+  if (ioctl(console, VT_OPENQRY, &vt) || (vt < 1) || ((fd = open_vt(vt)) < 0))
+    return perror(*argv), 1;
+  fstat(fd, &attr);
+  if (fchown(fd, user, (gid_t)-1))
+    return perror(*argv), close(fd), vt_release(vt), 1;
+  
+  /* the daemon, requests wait in the listener's backlog until it is ready */
+  if ((listener = daemon_listen()) < 0)
+    goto fail;
+  if ((daemon_pid = start_daemon(argv[1], listener)) < 0)
+    goto fail;
+  close(listener);
+  
+  /* the first request waits until the daemon is ready, so it is not counted */
+  for (i = 0; i <= rounds; i++)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      if (daemon_request(vt))
+	goto fail_daemon;
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      if (i)
+	{
+	  warm.latencies[i - 1] = test_elapsed(&start, &end);
+	  warm.total += warm.latencies[i - 1];
+	}
+      /* the lock is on a VT of its own, which is shown */
+      if (ioctl(console, VT_GETSTATE, &state) || type(state.v_active))
+	goto fail_daemon;
+      await_unlock(daemon_pid);
+    }
+  kill(daemon_pid, SIGTERM);
+  waitpid(daemon_pid, NULL, 0);
+  
+  /* the command line, the program is started anew each time */
+  for (i = 0; i < rounds; i++)
+    {
+      if ((cold_start.latencies[i] = cold(argv[1], user)) < 0)
+	{
+	  fprintf(stderr, "%s: the program did not lock and unlock\n", *argv);
+	  goto fail;
+	}
+      cold_start.total += cold_start.latencies[i];
+    }
+  
+  printf("%zu rounds\n", rounds);
+  report("daemon request to grab", &warm, rounds);
+  report("program start to grab", &cold_start, rounds);
+  printf("speedup: %.1f×\n", (double)cold_start.total / (double)(warm.total ? warm.total : 1));
+  rc = 0;
+  goto done;
+  
+ fail_daemon:
+  perror(*argv);
+  kill(daemon_pid, SIGTERM);
+  waitpid(daemon_pid, NULL, 0);
+  goto done;
+ fail:
+  perror(*argv);
+ done:
+  unlink(DAEMON_SOCKET);
+  if (fchown(fd, attr.st_uid, (gid_t)-1))
+    perror(*argv);
+  close(fd);
+  vt_switch(home);
+  vt_release(vt);
+  return rc;
+}
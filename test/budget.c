@@ -0,0 +1,477 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "common.h"
+#include "console.h"
+
+#include "lockdown.h"
+#include "kbddriver.h"
+#include "vt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/kd.h>
+#include <linux/vt.h>
+
+
+
+/**
+ * The number of extra modifier key presses, each followed by
+ * a release, that are typed when measuring keystrokes
+ */
+#define EXTRA_PAIRS  8
+
+/**
+ * The left shift key's scancode
+ */
+#define SHIFT  0x2A
+
+
+
+/**
+ * Counters shared by the test and every process in the lock
+ */
+struct counters
+{
+  /**
+   * Whether allocations are counted
+   */
+  volatile int enabled;
+  
+  /**
+   * The number of allocations made while counting
+   */
+  volatile unsigned long allocations;
+};
+
+
+/**
+ * The cost of a lock
+ */
+struct cost
+{
+  /**
+   * The number of system calls made by the lock's processes
+   */
+  long syscalls;
+  
+  /**
+   * The number of heap allocations made by the lock's processes
+   */
+  long allocations;
+};
+
+
+/**
+ * A budget from the budget file, and what was measured
+ */
+struct budget
+{
+  /**
+   * The name of the budget
+   */
+  const char* name;
+  
+  /**
+   * The number of keystrokes, attempts or locks the
+   * measurement covers, the budget is per one of them
+   */
+  long per;
+  
+  /**
+   * What was measured
+   */
+  long measured;
+  
+  /**
+   * The budget, -1 if it is not in the budget file
+   */
+  long budget;
+};
+
+
+
+/**
+ * The counters, `NULL` before they have been created
+ */
+static struct counters* counters = NULL;
+
+/**
+ * The emulated console, with each keystroke read on its own
+ */
+static struct platform keystrokes;
+
+
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+
+/**
+ * Count an allocation
+ */
+static void count_allocation(void)
+{
+  if (counters && counters->enabled)
+    __sync_add_and_fetch(&(counters->allocations), 1);
+}
+
+
+/**
+ * Allocate memory, and count it, see malloc(3)
+ * 
+ * @param   size  The number of bytes
+ * @return        The memory, `NULL` on error
+ */
+void* malloc(size_t size)
+{
+  count_allocation();
+  return __libc_malloc(size);
+}
+
+
+/**
+ * Allocate zeroed memory, and count it, see calloc(3)
+ * 
+ * @param   n     The number of elements
+ * @param   size  The size of each element
+ * @return        The memory, `NULL` on error
+ */
+void* calloc(size_t n, size_t size)
+{
+  count_allocation();
+  return __libc_calloc(n, size);
+}
+
+
+/**
+ * Resize memory, and count it, see realloc(3)
+ * 
+ * @param   ptr   The memory, `NULL` to allocate
+ * @param   size  The new number of bytes
+ * @return        The memory, `NULL` on error
+ */
+void* realloc(void* ptr, size_t size)
+{
+  count_allocation();
+  return __libc_realloc(ptr, size);
+}
+
+
+/**
+ * Read one keystroke from the keyboard, as when the user types,
+ * rather than everything that has been scripted at once
+ * 
+ * @param   fd   The keyboard
+ * @param   buf  Output buffer
+ * @param   n    The size of `buf`
+ * @return       The number of bytes read, -1 on error
+ */
+static ssize_t keystroke_read(int fd, void* buf, size_t n)
+{
+  return read(fd, buf, n ? 1 : 0);
+}
+
+
+/**
+ * Check whether a system call grabs the keyboard
+ * 
+ * @param   info  The system call, at its entry
+ * @return        Whether it grabs the keyboard
+ */
+static int __attribute__((pure)) grabs(const struct __ptrace_syscall_info* info)
+{
+  return (info->entry.nr == SYS_ioctl) && (info->entry.args[1] == KDSKBMODE) && (info->entry.args[2] == K_MEDIUMRAW);
+}
+
+
+/**
+ * Count the system calls of a traced process and its descendants
+ * 
+ * @param   child   The traced process, stopped by SIGSTOP
+ * @param   status  Output parameter for the process's exit status
+ * @param   grab    Whether to stop counting, and kill the process, when
+ *                  it is about to grab the keyboard, so that the keyboard
+ *                  is never grabbed, the system call is counted
+ * @return          The number of system calls, -1 on error, or if
+ *                  `grab` is set and the keyboard was not grabbed
+ */
+static long trace(pid_t child, int* status, int grab)
+{
+  struct __ptrace_syscall_info info;
+  long syscalls = 0;
+  int state, signo, counting = 1;
+  pid_t pid;
+  
+  if ((waitpid(child, &state, 0) != child) || !WIFSTOPPED(state))
+    return -1;
+  if (ptrace(PTRACE_SETOPTIONS, child, 0, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK |
+	     PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL))
+    return -1;
+  if (ptrace(PTRACE_SYSCALL, child, 0, 0))
+    return -1;
+  
+  while ((pid = waitpid(-1, &state, __WALL)) != -1)
+    {
+      if (!WIFSTOPPED(state))
+	{
+	  if (pid == child)
+	    *status = state;
+	  continue;
+	}
+      signo = WSTOPSIG(state);
+      if (signo == (SIGTRAP | 0x80))
+	{
+	  if ((ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) > 0) && (info.op == PTRACE_SYSCALL_INFO_ENTRY))
+	    {
+	      syscalls += counting;
+	      if (grab && counting && grabs(&info))
+		{
+		  counting = 0;
+		  kill(pid, SIGKILL); /* before the system call is made */
+		}
+	    }
+	  signo = 0;
+	}
+      else if ((signo == SIGTRAP) && (state >> 16))
+	signo = 0; /* a new process or program */
+      else if (signo == SIGSTOP)
+	signo = 0; /* a new process starts stopped */
+      ptrace(PTRACE_SYSCALL, pid, 0, signo);
+    }
+  if (errno != ECHILD)
+    return -1;
+  return (grab && counting) ? -1 : syscalls;
+}
+
+
+/**
+ * Measure a lock
+ * 
+ * @param   attempts  The number of attempts, all but the last are wrong
+ * @param   extra     Whether to type `EXTRA_PAIRS` modifier presses and
+ *                    releases in the last attempt
+ * @param   cost      Output parameter for the cost
+ * @return            Zero on success, -1 on error
+ */
+static int measure(int attempts, int extra, struct cost* cost)
+{
+  struct lock lock = { NULL, NULL, NULL, NULL, 0, -1 };
+  static uint8_t input[4096];
+  size_t n = 0;
+  int fds[2], i, status = -1;
+  pid_t pid;
+  
+  for (i = 1; i < attempts; i++)
+    n += test_type("qqq\n", input + n);
+  n += test_type(TEST_PASSPHRASE, input + n);
+  for (i = 0; extra && (i < EXTRA_PAIRS); i++)
+    {
+      input[n++] = SHIFT;
+      input[n++] = SHIFT | 0x80;
+    }
+  n += test_type("\n", input + n);
+  
+  if (pipe(fds))
+    return -1;
+  if (write(fds[1], input, n) != (ssize_t)n)
+    return close(fds[0]), close(fds[1]), -1;
+  lock.encrypted = test_encrypted();
+  counters->allocations = 0;
+  
+  if ((pid = fork()) == -1)
+    return close(fds[0]), close(fds[1]), -1;
+  if (pid == 0)
+    {
+      dup2(fds[0], STDIN_FILENO);
+      close(fds[0]);
+      close(fds[1]);
+      if (ptrace(PTRACE_TRACEME, 0, 0, 0))
+	_exit(2);
+      raise(SIGSTOP);
+      counters->enabled = 1;
+      _exit(lockdown(&lock) ? 1 : 0);
+    }
+  close(fds[0]);
+  close(fds[1]);
+  
+  cost->syscalls = trace(pid, &status, 0);
+  cost->allocations = (long)(counters->allocations);
+  if ((cost->syscalls < 0) || !WIFEXITED(status) || WEXITSTATUS(status))
+    return -1;
+  return 0;
+}
+
+
+/**
+ * Measure the system calls the program makes, from when it is
+ * started until it grabs the keyboard, on a fresh VT, as if it
+ * was installed with setuid and started by a user without a
+ * passphrase, it is killed before it grabs the keyboard
+ * 
+ * @param   program  The program, built with -DEBUG
+ * @return           The number of system calls, -1 on error
+ */
+static long measure_program(const char* program)
+{
+  uid_t user = test_unknown_user();
+  long syscalls;
+  int fds[2], vt, fd, status;
+  pid_t pid;
+  
+  if (!user || pipe(fds))
+    return -1;
+  if ((pid = fork()) == -1)
+    return close(fds[0]), close(fds[1]), -1;
+  if (pid == 0)
+    {
+      close(fds[0]);
+      setsid();
+      if ((fd = vt_open(&vt)) < 0)
+	_exit(1);
+      dup2(fd, STDIN_FILENO);
+      dup2(fd, STDOUT_FILENO);
+      dup2(fd, STDERR_FILENO);
+      if (setresuid(user, 0, 0) || (write(fds[1], &vt, sizeof(vt)) != (ssize_t)sizeof(vt)))
+	_exit(1);
+      close(fds[1]);
+      if (ptrace(PTRACE_TRACEME, 0, 0, 0))
+	_exit(2);
+      raise(SIGSTOP);
+      execl(program, program, NULL);
+      _exit(1);
+    }
+  close(fds[1]);
+  if (read(fds[0], &vt, sizeof(vt)) != (ssize_t)sizeof(vt))
+    vt = -1;
+  close(fds[0]);
+  
+  syscalls = trace(pid, &status, 1);
+  if (vt > 0)
+    vt_release(vt);
+  return vt > 0 ? syscalls : -1;
+}
+
+
+/**
+ * Check whether there are VTs we can lock
+ * 
+ * @return  Whether the program can be measured
+ */
+static int have_vts(void)
+{
+  int fd, vt, rc;
+  if (geteuid() || ((fd = open("/dev/tty0", O_RDONLY | O_NOCTTY | O_CLOEXEC)) < 0))
+    return 0;
+  rc = ioctl(fd, VT_OPENQRY, &vt);
+  close(fd);
+  return !rc && (vt > 0);
+}
+
+
+/**
+ * Measure the system calls per keystroke, the system calls
+ * and allocations per attempt, and the system calls to engage
+ * and release the lock, by running the lock in real processes,
+ * against an emulated console, under ptrace(2) and counting
+ * allocations, as well as the system calls the program makes
+ * until it has engaged the lock on a real VT, and fail if any
+ * budget is exceeded
+ * 
+ * The costs are the differences between locks that only
+ * differ in the number of keystrokes or attempts
+ * 
+ * @param   argc  The number of elements in `argv`
+ * @param   argv  The program name, the budget file, and
+ *                the program built with -DEBUG
+ * @return        0 if every budget is kept, 1 otherwise
+ */
+int main(int argc, char** argv)
+{
+  const struct kbdlayout* layouts[] = { &test_layout };
+  struct budget budgets[] =
+    {
+      { "syscalls-per-keystroke",  2 * EXTRA_PAIRS, 0, -1 },
+      { "syscalls-per-attempt",    1,               0, -1 },
+      { "allocations-per-attempt", 1,               0, -1 },
+      { "syscalls-in-lockdown",    1,               0, -1 },
+      { "syscalls-at-engagement",  1,               0, -1 }
+    };
+  struct cost one, two, typed;
+  void* mem;
+  size_t i;
+  int rc = 0;
+  
+  if (argc != 3)
+    return fprintf(stderr, "Usage: %s BUDGET-FILE PROGRAM\n", *argv), 1;
+  for (i = 0; i < sizeof(budgets) / sizeof(*budgets); i++)
+    if ((budgets[i].budget = test_budget(argv[1], budgets[i].name)) == -2)
+      return perror(argv[1]), 1;
+  
+  mem = mmap(NULL, sizeof(*counters), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if ((mem == MAP_FAILED) || console_start())
+    return perror(*argv), 1;
+  counters = mem;
+  keystrokes = platform_console;
+  keystrokes.read = keystroke_read;
+  platform = &keystrokes;
+  kbddriver_layouts(layouts, 1);
+  
+  if (measure(1, 0, &one) || measure(2, 0, &two) || measure(1, 1, &typed))
+    return fprintf(stderr, "%s: the lock could not be measured\n", *argv), 1;
+  budgets[0].measured = typed.syscalls - one.syscalls;
+  budgets[1].measured = two.syscalls - one.syscalls;
+  budgets[2].measured = two.allocations - one.allocations;
+  budgets[3].measured = 2 * one.syscalls - two.syscalls;
+  
+  /* the program has to be run on a real VT, which only root can open */
+  if (!have_vts())
+    budgets[4].measured = -1;
+  else if ((budgets[4].measured = measure_program(argv[2])) < 0)
+    return fprintf(stderr, "%s: the program could not be measured\n", *argv), 1;
+  
+  for (i = 0; i < sizeof(budgets) / sizeof(*budgets); i++)
+    {
+      if (budgets[i].measured < 0)
+	{
+	  printf("%-24s skipped, there are no VTs\n", budgets[i].name);
+	  continue;
+	}
+      printf("%-24s %6.1f (budget %li)", budgets[i].name,
+	     (double)(budgets[i].measured) / (double)(budgets[i].per), budgets[i].budget);
+      if (budgets[i].budget < 0)
+	printf(" no budget\n"), rc = 1;
+      else if (budgets[i].measured > budgets[i].budget * budgets[i].per)
+	printf(" OVER BUDGET\n"), rc = 1;
+      else
+	printf("\n");
+    }
+  return rc;
+}
@@ -0,0 +1,215 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <crypt.h>
+#include <pwd.h>
+#include <linux/kd.h>
+#include <linux/keyboard.h>
+
+
+
+/**
+ * The first user ID that is tried as a user that does not exist
+ */
+#define UNKNOWN_USER_FIRST  60000
+
+/**
+ * The last user ID that is tried as a user that does not exist
+ */
+#define UNKNOWN_USER_LAST  65533
+
+
+
+/**
+ * The keycodes of the letters, in alphabetical order
+ */
+static const uint8_t letters[26] =
+  {
+    0x1E, 0x30, 0x2E, 0x20, 0x12, 0x21, 0x22, 0x23, 0x17, 0x24, 0x25, 0x26, 0x32,
+    0x31, 0x18, 0x19, 0x10, 0x13, 0x1F, 0x14, 0x16, 0x2F, 0x11, 0x2D, 0x15, 0x2C
+  };
+
+/**
+ * The test layout's keymap without modifiers
+ */
+static unsigned short plain_map[NR_KEYS];
+
+/**
+ * The test layout's keymap with shift
+ */
+static unsigned short shift_map[NR_KEYS];
+
+/**
+ * The test layout's keymaps
+ */
+static unsigned short* key_maps[MAX_NR_KEYMAPS] = { plain_map, shift_map };
+
+/**
+ * The test layout's function key strings, there are none
+ */
+static char* func_table[MAX_NR_FUNC];
+
+/**
+ * The test layout's compositions, there are none
+ */
+static struct kbdiacr accent_table[1];
+
+/**
+ * The number of compositions in the test layout
+ */
+static const unsigned int accent_table_size = 0;
+
+
+
+/**
+ * A US layout with only the letters, Enter and the shift keys,
+ * so that the tests do not depend on the layout the program
+ * was built with
+ */
+const struct kbdlayout test_layout =
+  {
+    .key_maps          = key_maps,
+    .func_table        = func_table,
+    .accent_table      = accent_table,
+    .accent_table_size = &accent_table_size,
+    .name              = "test"
+  };
+
+
+
+/**
+ * Fill in the test layout's keymaps
+ */
+static void __attribute__((constructor)) build_layout(void)
+{
+  size_t i;
+  for (i = 0; i < NR_KEYS; i++)
+    plain_map[i] = shift_map[i] = K_HOLE | 0xF000;
+  for (i = 0; i < 26; i++)
+    {
+      plain_map[letters[i]] = (unsigned short)(K(KT_LETTER, 'a' + i) | 0xF000);
+      shift_map[letters[i]] = (unsigned short)(K(KT_LETTER, 'A' + i) | 0xF000);
+    }
+  plain_map[0x1C] = shift_map[0x1C] = K_ENTER | 0xF000;
+  plain_map[0x2A] = shift_map[0x2A] = K_SHIFTL | 0xF000;
+  plain_map[0x36] = shift_map[0x36] = K_SHIFTR | 0xF000;
+}
+
+
+/**
+ * Get the encrypted test passphrase, with a cheap hash
+ * method if one is available, so that the tests measure
+ * the lock rather than the hash
+ * 
+ * @return  The encrypted passphrase
+ */
+const char* test_encrypted(void)
+{
+  static char encrypted[128] = { '\0' };
+  const char* hash;
+  if (*encrypted)
+    return encrypted;
+  hash = crypt(TEST_PASSPHRASE, "$1$lockdown$");
+  if ((hash == NULL) || (*hash != '$') || (strlen(hash) >= sizeof(encrypted)))
+    hash = "$6$MWcK52I9$xKtRFG3JIRfuC80R/8fu3vDO6qPRy6IK6B8GsaA6n.HvdP8J3M9n0.nNc/ZcdkzHWApXCVsQBk4V.YGsmfkNv1";
+  strcpy(encrypted, hash);
+  return encrypted;
+}
+
+
+/**
+ * Convert a text to medium raw scancodes for `test_layout`,
+ * each character is pressed and released
+ * 
+ * @param   text       The text, only lower case letters and LF
+ * @param   scancodes  Output buffer, twice the length of `text`
+ * @return             The number of scancodes
+ */
+size_t test_type(const char* text, uint8_t* scancodes)
+{
+  size_t n = 0;
+  uint8_t key;
+  for (; *text; text++)
+    {
+      key = *text == '\n' ? 0x1C : letters[(*text - 'a') & 31];
+      scancodes[n++] = key;
+      scancodes[n++] = key | 0x80;
+    }
+  return n;
+}
+
+
+/**
+ * Look up a budget in a budget file, where each line is
+ * a name and a number, and lines starting with # are ignored
+ * 
+ * @param   path  The budget file
+ * @param   name  The name of the budget
+ * @return        The budget, -1 if it is missing, -2 if the
+ *                file could not be read
+ */
+long test_budget(const char* path, const char* name)
+{
+  char line[256], key[128];
+  long value, budget = -1;
+  FILE* f;
+  
+  if ((f = fopen(path, "r")) == NULL)
+    return -2;
+  while (fgets(line, sizeof(line), f))
+    if ((*line != '#') && (sscanf(line, "%127s %li", key, &value) == 2) && !strcmp(key, name))
+      budget = value;
+  fclose(f);
+  return budget;
+}
+
+
+/**
+ * Get the number of nanoseconds between two points in time
+ * 
+ * @param   start  The earlier point in time
+ * @param   end    The later point in time
+ * @return         `end` − `start` in nanoseconds
+ */
+long long test_elapsed(const struct timespec* start, const struct timespec* end)
+{
+  return (long long)(end->tv_sec - start->tv_sec) * 1000000000LL + (long long)(end->tv_nsec - start->tv_nsec);
+}
+
+
+/**
+ * Find a user ID that nobody has, the program cannot look up a
+ * passphrase for such a user, so when it is built with -DEBUG,
+ * it unlocks with the test passphrase
+ * 
+ * @return  The user ID, 0 if there is none
+ */
+uid_t test_unknown_user(void)
+{
+  uid_t uid;
+  for (uid = UNKNOWN_USER_FIRST; uid <= UNKNOWN_USER_LAST; uid++)
+    if (getpwuid(uid) == NULL)
+      return uid;
+  return 0;
+}
+
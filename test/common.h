@@ -0,0 +1,96 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_TEST_COMMON_H
+#define TOTAL_LOCKDOWN_TEST_COMMON_H
+
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "kbddecoder.h"
+
+
+
+/**
+ * The passphrase the tests unlock with
+ */
+#define TEST_PASSPHRASE  "ppp"
+
+
+
+/**
+ * A US layout with only the letters, Enter and the shift keys,
+ * so that the tests do not depend on the layout the program
+ * was built with
+ */
+extern const struct kbdlayout test_layout;
+
+
+/**
+ * Get the encrypted test passphrase, with a cheap hash
+ * method if one is available, so that the tests measure
+ * the lock rather than the hash
+ * 
+ * @return  The encrypted passphrase
+ */
+const char* test_encrypted(void);
+
+/**
+ * Convert a text to medium raw scancodes for `test_layout`,
+ * each character is pressed and released
+ * 
+ * @param   text       The text, only lower case letters and LF
+ * @param   scancodes  Output buffer, twice the length of `text`
+ * @return             The number of scancodes
+ */
+size_t test_type(const char* text, uint8_t* scancodes);
+
+/**
+ * Look up a budget in a budget file, where each line is
+ * a name and a number, and lines starting with # are ignored
+ * 
+ * @param   path  The budget file
+ * @param   name  The name of the budget
+ * @return        The budget, -1 if it is missing, -2 if the
+ *                file could not be read
+ */
+long test_budget(const char* path, const char* name);
+
+/**
+ * Get the number of nanoseconds between two points in time
+ * 
+ * @param   start  The earlier point in time
+ * @param   end    The later point in time
+ * @return         `end` − `start` in nanoseconds
+ */
+long long test_elapsed(const struct timespec* start, const struct timespec* end) __attribute__((pure));
+
+/**
+ * Find a user ID that nobody has, the program cannot look up a
+ * passphrase for such a user, so when it is built with -DEBUG,
+ * it unlocks with the test passphrase
+ * 
+ * @return  The user ID, 0 if there is none
+ */
+uid_t test_unknown_user(void);
+
+
+#endif
+
@@ -0,0 +1,255 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "console.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <linux/kd.h>
+
+
+
+/**
+ * The emulated console, `NULL` before `console_start`
+ */
+struct console* console = NULL;
+
+/**
+ * The pathname of the emulated console
+ */
+static char console_tty[] = "/dev/tty63";
+
+
+
+/**
+ * Get the pathname of the emulated console
+ * 
+ * @param   fd  Ignored
+ * @return      The pathname
+ */
+static char* console_ttyname(int fd)
+{
+  (void) fd;
+  return console_tty;
+}
+
+
+/**
+ * Get the emulated console's terminal attributes
+ * 
+ * @param   fd    Ignored
+ * @param   attr  Output parameter for the attributes
+ * @return        Zero
+ */
+static int console_tcgetattr(int fd, struct termios* attr)
+{
+  (void) fd;
+  *attr = console->attr;
+  return 0;
+}
+
+
+/**
+ * Set the emulated console's terminal attributes
+ * 
+ * @param   fd      Ignored
+ * @param   action  Ignored
+ * @param   attr    The attributes
+ * @return          Zero
+ */
+static int console_tcsetattr(int fd, int action, const struct termios* attr)
+{
+  (void) fd;
+  (void) action;
+  console->attr = *attr;
+  return 0;
+}
+
+
+/**
+ * Get the emulated console's keyboard mode
+ * 
+ * @param   fd    Ignored
+ * @param   mode  Output parameter for the mode
+ * @return        Zero
+ */
+static int console_getkbmode(int fd, int* mode)
+{
+  (void) fd;
+  *mode = console->kbmode;
+  return 0;
+}
+
+
+/**
+ * Set the emulated console's keyboard mode
+ * 
+ * @param   fd    Ignored
+ * @param   mode  The mode
+ * @return        Zero
+ */
+static int console_setkbmode(int fd, int mode)
+{
+  (void) fd;
+  console->kbmode = mode;
+  return 0;
+}
+
+
+/**
+ * Discard a text printed on the lock screen
+ * 
+ * @param  text  The text
+ */
+static void console_print(const char* text)
+{
+  (void) text;
+}
+
+
+/**
+ * Run a function in a forked process, which is killed
+ * if its parent dies, like on the real operating system
+ * 
+ * @param   function  The function
+ * @param   arg       Argument for the function
+ * @return            The process ID, -1 on error
+ */
+static pid_t console_spawn(int (*function)(const void* arg), const void* arg)
+{
+  pid_t parent = getpid();
+  pid_t pid = fork();
+  if (pid == 0)
+    {
+      if (prctl(PR_SET_PDEATHSIG, SIGKILL) || (getppid() != parent))
+	_exit(1);
+      exit(function(arg));
+    }
+  return pid;
+}
+
+
+/**
+ * Wait for a process to exit
+ * 
+ * @param   pid     The process ID
+ * @param   status  Output parameter for the status
+ * @return          `pid` on success, -1 on error
+ */
+static pid_t console_wait(pid_t pid, int* status)
+{
+  return waitpid(pid, status, 0);
+}
+
+
+/**
+ * Read a passphrase from a pipe
+ * 
+ * @param   fd  The read end of the pipe
+ * @return      The passphrase, without the terminating LF
+ */
+static char* console_readpass(int fd)
+{
+  char* passphrase = calloc(256, 1);
+  size_t ptr = 0;
+  
+  if (passphrase == NULL)
+    abort();
+  while ((ptr < 255) && (read(fd, passphrase + ptr, 1) == 1) && (passphrase[ptr] != '\n'))
+    ptr++;
+  passphrase[ptr] = '\0';
+  return passphrase;
+}
+
+
+/**
+ * Return immediately, rather than sleeping
+ * 
+ * @param   seconds  Ignored
+ * @return           Zero
+ */
+static unsigned int console_sleep(unsigned int seconds)
+{
+  (void) seconds;
+  return 0;
+}
+
+
+/**
+ * Get the monotonic time
+ * 
+ * @param  time  Output parameter for the time
+ */
+static void console_now(struct timespec* time)
+{
+  clock_gettime(CLOCK_MONOTONIC, time);
+}
+
+
+
+/**
+ * The operating system, with the console emulated, keyboard
+ * input is read from stdin, the lock screen is discarded and
+ * sleeping returns immediately
+ */
+const struct platform platform_console =
+  {
+    .ttyname   = console_ttyname,
+    .tcgetattr = console_tcgetattr,
+    .tcsetattr = console_tcsetattr,
+    .getkbmode = console_getkbmode,
+    .setkbmode = console_setkbmode,
+    .read      = read,
+    .print     = console_print,
+    .spawn     = console_spawn,
+    .wait      = console_wait,
+    .kill      = kill,
+    .readpass  = console_readpass,
+    .sleep     = console_sleep,
+    .now       = console_now
+  };
+
+
+/**
+ * Create the emulated console and make the lock run against it,
+ * processes forked after this share the console
+ * 
+ * @return  Zero on success, -1 on error
+ */
+int console_start(void)
+{
+  void* mem = mmap(NULL, sizeof(*console), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+    return -1;
+  console = mem;
+  memset(console, 0, sizeof(*console));
+  console->attr.c_iflag = ICRNL | IXON;
+  console->attr.c_oflag = OPOST | ONLCR;
+  console->attr.c_cflag = CREAD | CS8;
+  console->attr.c_lflag = ISIG | ICANON | ECHO | ECHOE | ECHOK | IEXTEN;
+  console->kbmode = K_XLATE;
+  platform = &platform_console;
+  return 0;
+}
+
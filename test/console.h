@@ -0,0 +1,71 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOTAL_LOCKDOWN_TEST_CONSOLE_H
+#define TOTAL_LOCKDOWN_TEST_CONSOLE_H
+
+
+#include <termios.h>
+
+#include "platform.h"
+
+
+
+/**
+ * An emulated console, shared by all processes of the lock
+ * and the test, so that the test can observe and damage it
+ * while the lock runs in real processes
+ */
+struct console
+{
+  /**
+   * The console's terminal attributes
+   */
+  struct termios attr;
+  
+  /**
+   * The console's keyboard mode
+   */
+  volatile int kbmode;
+};
+
+
+
+/**
+ * The emulated console, `NULL` before `console_start`
+ */
+extern struct console* console;
+
+/**
+ * The operating system, with the console emulated, keyboard
+ * input is read from stdin, the lock screen is discarded and
+ * sleeping returns immediately
+ */
+extern const struct platform platform_console;
+
+
+/**
+ * Create the emulated console and make the lock run against it,
+ * processes forked after this share the console
+ * 
+ * @return  Zero on success, -1 on error
+ */
+int console_start(void);
+
+
+#endif
+
@@ -0,0 +1,209 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "common.h"
+#include "console.h"
+
+#include "lockdown.h"
+#include "kbddriver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <linux/kd.h>
+
+
+
+/**
+ * The longest time, in nanoseconds, the console may be
+ * left unlocked after a process of the lock is killed
+ */
+#define RECOVERY_BUDGET  (100 * 1000000LL)
+
+/**
+ * The maximum number of processes of the lock
+ */
+#define MAX_PROCESSES  8
+
+
+
+/**
+ * The process that called `lockdown`
+ */
+static pid_t supervisor;
+
+
+
+/**
+ * List the processes of the lock, that can touch the console,
+ * that is, the guard and its attempt, but not the verifier
+ * 
+ * @param   pids  Output parameter for the process IDs
+ * @return        The number of processes
+ */
+static size_t processes(pid_t* pids)
+{
+  char path[64];
+  FILE* f;
+  size_t i, n = 0, generation = 0, end;
+  long pid;
+  
+  pids[n++] = supervisor;
+  for (i = 0; generation < 2; generation++)
+    {
+      for (end = n; i < end; i++)
+	{
+	  snprintf(path, sizeof(path), "/proc/%li/task/%li/children", (long)pids[i], (long)pids[i]);
+	  if ((f = fopen(path, "r")) == NULL)
+	    continue;
+	  while ((n < MAX_PROCESSES) && (fscanf(f, "%li", &pid) == 1))
+	    pids[n++] = (pid_t)pid;
+	  fclose(f);
+	}
+    }
+  memmove(pids, pids + 1, --n * sizeof(*pids));
+  return n;
+}
+
+
+/**
+ * Check whether a process has died
+ * 
+ * @param   pid  The process ID
+ * @return       Whether the process is a zombie or gone
+ */
+static int dead(pid_t pid)
+{
+  char path[64], state = 'Z';
+  FILE* f;
+  snprintf(path, sizeof(path), "/proc/%li/stat", (long)pid);
+  if ((f = fopen(path, "r")) == NULL)
+    return 1;
+  if (fscanf(f, "%*d (%*[^)]) %c", &state) != 1)
+    state = 'Z';
+  fclose(f);
+  return state == 'Z';
+}
+
+
+/**
+ * Wait until the console is locked
+ * 
+ * @param   deadline  How many nanoseconds to wait at most
+ * @return            The number of nanoseconds waited,
+ *                    -1 if the deadline passed
+ */
+static long long engaged(long long deadline)
+{
+  struct timespec start, now, pause = { 0, 20000 };
+  long long waited;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (;;)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      waited = test_elapsed(&start, &now);
+      if ((console->kbmode == K_MEDIUMRAW) && !(console->attr.c_lflag & ECHO))
+	return waited;
+      if (waited > deadline)
+	return -1;
+      nanosleep(&pause, NULL);
+    }
+}
+
+
+/**
+ * Run the lock in real processes against an emulated console,
+ * repeatedly damage the console and kill one of the lock's
+ * processes, as a crashing process could, and check that the
+ * lock is re-engaged within the recovery budget, then unlock
+ * and check that the console is restored
+ * 
+ * @param   argc  The number of elements in `argv`
+ * @param   argv  The program name, and optionally the number of faults
+ * @return        0 on success, 1 on failure
+ */
+int main(int argc, char** argv)
+{
+  static uint8_t input[2 * sizeof(TEST_PASSPHRASE "\n")];
+  const struct kbdlayout* layouts[] = { &test_layout };
+  struct lock lock = { NULL, NULL, NULL, NULL, 0, -1 };
+  struct termios attr;
+  pid_t pids[MAX_PROCESSES];
+  long long exposure, total = 0, worst = 0;
+  size_t i, j, n, victim, faults = argc > 1 ? (size_t)atol(argv[1]) : 200;
+  int fds[2], status;
+  
+  if (console_start() || pipe(fds))
+    return perror(*argv), 1;
+  attr = console->attr;
+  lock.encrypted = test_encrypted();
+  kbddriver_layouts(layouts, 1);
+  srand((unsigned)getpid());
+  
+  if ((supervisor = fork()) == -1)
+    return perror(*argv), 1;
+  if (supervisor == 0)
+    {
+      close(fds[1]);
+      dup2(fds[0], STDIN_FILENO);
+      close(fds[0]);
+      exit(lockdown(&lock) ? 1 : 0);
+    }
+  close(fds[0]);
+  if (engaged(RECOVERY_BUDGET * 10) < 0)
+    return fprintf(stderr, "%s: the lock was not engaged\n", *argv), kill(supervisor, SIGKILL), 1;
+  
+  for (i = 0; i < faults; i++)
+    {
+      while ((n = processes(pids)) < 2)
+	usleep(100);
+      console->kbmode = K_XLATE;
+      console->attr.c_lflag |= ECHO;
+      victim = (size_t)rand() % n;
+      kill(pids[victim], SIGKILL);
+      if ((exposure = engaged(RECOVERY_BUDGET)) < 0)
+	return fprintf(stderr, "%s: fault %zu: the lock was not re-engaged\n", *argv, i), kill(supervisor, SIGKILL), 1;
+      /* the attempt of a killed guard dies with it, but it may still
+       * be reading the keyboard when the new guard has taken over */
+      for (j = victim; j < n; j++)
+	while (!dead(pids[j]))
+	  usleep(10);
+      total += exposure;
+      worst = exposure > worst ? exposure : worst;
+    }
+  
+  n = test_type(TEST_PASSPHRASE "\n", input);
+  if (write(fds[1], input, n) != (ssize_t)n)
+    return perror(*argv), kill(supervisor, SIGKILL), 1;
+  if (waitpid(supervisor, &status, 0) != supervisor)
+    return perror(*argv), 1;
+  if (!WIFEXITED(status) || WEXITSTATUS(status))
+    return fprintf(stderr, "%s: the lock failed\n", *argv), 1;
+  if (console->kbmode != K_XLATE)
+    return fprintf(stderr, "%s: the keyboard mode was not restored\n", *argv), 1;
+  if (memcmp(&attr, &(console->attr), sizeof(attr)))
+    return fprintf(stderr, "%s: the terminal attributes were not restored\n", *argv), 1;
+  
+  printf("%zu faults, exposure: mean %lld ns, max %lld ns\n", faults, total / (long long)(faults ? faults : 1), worst);
+  return 0;
+}
+
@@ -0,0 +1,185 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "common.h"
+#include "console.h"
+
+#include "lockdown.h"
+#include "kbddriver.h"
+#include "usage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <linux/kd.h>
+
+
+
+/**
+ * The number of processes in an idle lock: the
+ * supervisor, the guard, the attempt and the verifier
+ */
+#define LOCK_PROCESSES  4
+
+
+
+/**
+ * The number of times the supervisor has been interrupted
+ */
+static volatile sig_atomic_t interruptions = 0;
+
+
+
+/**
+ * Do nothing, but interrupt the supervisor
+ * 
+ * @param  signo  The received signal
+ */
+static void interrupt(int signo)
+{
+  (void) signo;
+}
+
+
+/**
+ * Count an interruption of the supervisor
+ */
+static void interrupted(void)
+{
+  interruptions++;
+}
+
+
+/**
+ * Count the processes in a process tree
+ * 
+ * @param   pid  The root of the tree
+ * @param   all  Output parameter for the process IDs, may be `NULL`
+ * @return       The number of processes
+ */
+static size_t count_processes(pid_t pid, pid_t* all)
+{
+  char path[64];
+  long child;
+  size_t n = 1;
+  FILE* f;
+  
+  if (all)
+    *all++ = pid;
+  snprintf(path, sizeof(path), "/proc/%li/task/%li/children", (long)pid, (long)pid);
+  if ((f = fopen(path, "r")) == NULL)
+    return n;
+  while (fscanf(f, "%li", &child) == 1)
+    n += count_processes((pid_t)child, all ? all + n - 1 : NULL);
+  fclose(f);
+  return n;
+}
+
+
+/**
+ * Run the lock in real processes against an emulated console,
+ * wait while nobody types, and fail if the lock's processes
+ * wake up more often than the budget allows, then send SIGUSR1,
+ * which asks for a usage report, to every process in the lock,
+ * and check that it only interrupts the supervisor, and that the
+ * lock still unlocks
+ * 
+ * @param   argc  The number of elements in `argv`
+ * @param   argv  The program name, the budget file, and optionally
+ *                the number of seconds to wait
+ * @return        0 on success, 1 on failure
+ */
+int main(int argc, char** argv)
+{
+  static uint8_t input[2 * sizeof(TEST_PASSPHRASE "\n")];
+  const struct kbdlayout* layouts[] = { &test_layout };
+  struct lock lock = { NULL, NULL, NULL, NULL, 0, -1 };
+  struct sigaction action;
+  struct usage before, after;
+  struct timespec settle = { 0, 100000000L };
+  pid_t pids[LOCK_PROCESSES], supervisor;
+  unsigned int seconds;
+  long budget, per_minute;
+  size_t i, n;
+  int fds[2], status;
+  
+  if ((argc < 2) || (argc > 3))
+    return fprintf(stderr, "Usage: %s BUDGET-FILE [SECONDS]\n", *argv), 1;
+  seconds = argc > 2 ? (unsigned int)atoi(argv[2]) : 3;
+  seconds = seconds ? seconds : 1;
+  if ((budget = test_budget(argv[1], "idle-wakeups-per-minute")) < 0)
+    return fprintf(stderr, "%s: idle-wakeups-per-minute is not in %s\n", *argv, argv[1]), 1;
+  if (console_start() || pipe(fds))
+    return perror(*argv), 1;
+  lock.encrypted = test_encrypted();
+  lock.interrupted = interrupted;
+  kbddriver_layouts(layouts, 1);
+  
+  if ((supervisor = fork()) == -1)
+    return perror(*argv), 1;
+  if (supervisor == 0)
+    {
+      /* as the program does it, without SA_RESTART, so that the lock notices */
+      memset(&action, 0, sizeof(action));
+      action.sa_handler = interrupt;
+      sigemptyset(&(action.sa_mask));
+      sigaction(SIGUSR1, &action, NULL);
+      close(fds[1]);
+      dup2(fds[0], STDIN_FILENO);
+      close(fds[0]);
+      exit(lockdown(&lock) ? 1 : interruptions == 1 ? 0 : 2);
+    }
+  close(fds[0]);
+  
+  /* wait until the attempt is waiting for the keyboard */
+  while ((console->kbmode != K_MEDIUMRAW) || (count_processes(supervisor, NULL) < LOCK_PROCESSES))
+    nanosleep(&settle, NULL);
+  nanosleep(&settle, NULL);
+  
+  usage_measure(supervisor, &before);
+  sleep(seconds);
+  usage_measure(supervisor, &after);
+  per_minute = (long)(after.wakeups - before.wakeups) * 60 / (long)seconds;
+  printf("idle for %us: %lu wakeups, %li per minute (budget %li), %llu µs CPU\n", seconds,
+	 after.wakeups - before.wakeups, per_minute, budget, after.cpu - before.cpu);
+  
+  /* every process in the lock may be sent SIGUSR1, for example by pkill */
+  if ((n = count_processes(supervisor, pids)) > LOCK_PROCESSES)
+    n = LOCK_PROCESSES;
+  for (i = 0; i < n; i++)
+    kill(pids[i], SIGUSR1);
+  nanosleep(&settle, NULL);
+  
+  n = test_type(TEST_PASSPHRASE "\n", input);
+  if (write(fds[1], input, n) != (ssize_t)n)
+    return perror(*argv), kill(supervisor, SIGKILL), 1;
+  if (waitpid(supervisor, &status, 0) != supervisor)
+    return perror(*argv), 1;
+  if (!WIFEXITED(status) || (WEXITSTATUS(status) == 1))
+    return fprintf(stderr, "%s: the lock did not survive SIGUSR1\n", *argv), 1;
+  if (WEXITSTATUS(status))
+    return fprintf(stderr, "%s: SIGUSR1 did not interrupt only the supervisor, once\n", *argv), 1;
+  if (per_minute > budget)
+    return fprintf(stderr, "%s: the lock wakes up while idle\n", *argv), 1;
+  return 0;
+}
+
@@ -0,0 +1,158 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "common.h"
+
+#include "audit.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+
+
+/**
+ * How long, in milliseconds, an event may take to reach the journal,
+ * an event that is stuck behind a dead producer's event is given
+ * longer, since the writer waits a while before it gives up on it
+ */
+#define DEADLINE_MS  5000
+
+/**
+ * How long, in milliseconds, an event may take to reach the
+ * journal once the dead producer's event has been skipped
+ */
+#define PROMPT_MS  500
+
+
+
+/**
+ * Whether the process is killed when it is about to timestamp
+ * its event, that is, between claiming a slot and writing it
+ */
+static volatile int die_mid_claim = 0;
+
+
+
+/**
+ * Get the time, see clock_gettime(3), but kill the process
+ * instead, if it is about to write an event and it should die
+ * 
+ * @param   clock  The clock
+ * @param   time   Output parameter for the time
+ * @return         Zero on success, -1 on error
+ */
+int clock_gettime(clockid_t clock, struct timespec* time)
+{
+  if (die_mid_claim && (clock == CLOCK_REALTIME))
+    kill(getpid(), SIGKILL);
+  return (int)syscall(SYS_clock_gettime, clock, time);
+}
+
+
+/**
+ * Wait until the journal contains a text
+ * 
+ * @param   journal   The journal
+ * @param   text      The text
+ * @param   deadline  How many milliseconds to wait at most
+ * @return            The number of milliseconds it took, -1 if it did not appear
+ */
+static long await_journal(const char* journal, const char* text, long deadline)
+{
+  static char content[1 << 16];
+  struct timespec start, now, pause = { 0, 1000000L };
+  ssize_t got;
+  long waited;
+  int fd;
+  
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (;;)
+    {
+      if ((fd = open(journal, O_RDONLY)) >= 0)
+	{
+	  got = read(fd, content, sizeof(content) - 1);
+	  close(fd);
+	  content[got < 0 ? 0 : got] = '\0';
+	}
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      waited = (long)(test_elapsed(&start, &now) / 1000000LL);
+      if ((fd >= 0) && strstr(content, text))
+	return waited;
+      if (waited > deadline)
+	return -1;
+      nanosleep(&pause, NULL);
+    }
+}
+
+
+/**
+ * Kill a process that records an attempt after it has claimed a slot
+ * in the audit ring but before it has written its event, as the guard
+ * may kill an attempt, and check that later events still reach the
+ * journal, with the dead producer's event counted as dropped
+ * 
+ * @param   argc  The number of elements in `argv`
+ * @param   argv  The program name and the journal, which
+ *                the audit writer is built to use
+ * @return        0 on success, 1 on failure
+ */
+int main(int argc, char** argv)
+{
+  long stalled, prompt;
+  int status;
+  pid_t pid;
+  
+  if (argc != 2)
+    return fprintf(stderr, "Usage: %s JOURNAL\n", *argv), 1;
+  unlink(argv[1]);
+  if (audit_start())
+    return perror(*argv), 1;
+  
+  if ((pid = fork()) == -1)
+    return perror(*argv), 1;
+  if (pid == 0)
+    {
+      die_mid_claim = 1;
+      audit_attempt(AUDIT_FAILURE, 8);
+      _exit(1);
+    }
+  if ((waitpid(pid, &status, 0) != pid) || !WIFSIGNALED(status))
+    return fprintf(stderr, "%s: the producer was not killed mid-claim\n", *argv), 1;
+  
+  /* this one is stuck behind the dead producer's until the writer gives up on it */
+  audit_attempt(AUDIT_SUCCESS, 3);
+  if ((stalled = await_journal(argv[1], "verdict=success", DEADLINE_MS)) < 0)
+    return fprintf(stderr, "%s: a dead producer stalled the journal\n", *argv), 1;
+  if (await_journal(argv[1], "dropped=1\n", 0) < 0)
+    return fprintf(stderr, "%s: the dead producer's event was not counted as dropped\n", *argv), 1;
+  
+  /* and then the journal is back to normal */
+  audit_attempt(AUDIT_ERROR, 3);
+  if ((prompt = await_journal(argv[1], "verdict=error", PROMPT_MS)) < 0)
+    return fprintf(stderr, "%s: the journal did not recover from a dead producer\n", *argv), 1;
+  
+  printf("dead producer skipped after %li ms, next event written after %li ms\n", stalled, prompt);
+  unlink(argv[1]);
+  return 0;
+}
@@ -0,0 +1,174 @@
+/**
+ * total-lockdown – Lock the current TTY and hinder switch to another
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+
+#include "common.h"
+
+#include "lockdown.h"
+#include "kbddriver.h"
+#include "simulation.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/kd.h>
+
+
+
+/**
+ * The input for one cycle: a wrong attempt and then the right one
+ */
+#define CYCLE_TEXT  "wrong\n" TEST_PASSPHRASE "\n"
+
+
+
+/**
+ * Compare latencies, for qsort(3)
+ * 
+ * @param   a  One of the latencies
+ * @param   b  The other latency
+ * @return     Negative if `a` is shorter, positive if `b` is
+ *             shorter, zero if they are equal
+ */
+static int compare(const void* a, const void* b)
+{
+  long long x = *(const long long*)a, y = *(const long long*)b;
+  return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Pretend that the passphrase has been changed to the test passphrase
+ * 
+ * @return  The encrypted test passphrase
+ */
+static const char* changed(void)
+{
+  return test_encrypted();
+}
+
+
+/**
+ * Pretend that the passphrase could not be resolved after a change
+ * 
+ * @return  The revoked passphrase
+ */
+static const char* revoked(void)
+{
+  return "!";
+}
+
+
+/**
+ * Lock and unlock the simulated console repeatedly, check that
+ * the console is restored after each cycle, and print the latency
+ * distribution of the cycles, excluding the time that the lock
+ * would have slept after the wrong attempt
+ * 
+ * @param   argc  The number of elements in `argv`
+ * @param   argv  The program name, and optionally the number of cycles
+ * @return        0 on success, 1 on failure
+ */
+int main(int argc, char** argv)
+{
+  static uint8_t input[2 * sizeof(CYCLE_TEXT)];
+  const struct kbdlayout* layouts[] = { &test_layout };
+  struct lock lock = { NULL, NULL, NULL, NULL, 0, -1 };
+  struct simulation sim;
+  struct termios attr;
+  struct timespec start, end;
+  long long* latencies;
+  long long total = 0;
+  size_t i, n, cycles = argc > 1 ? (size_t)atol(argv[1]) : 1000;
+  int rc;
+  
+  if (cycles == 0)
+    cycles = 1;
+  if ((latencies = malloc(cycles * sizeof(*latencies))) == NULL)
+    return perror(*argv), 1;
+  lock.encrypted = test_encrypted();
+  n = test_type(CYCLE_TEXT, input);
+  kbddriver_layouts(layouts, 1);
+  
+  for (i = 0; i < cycles; i++)
+    {
+      simulation_start(&sim, input, n);
+      attr = sim.attr;
+      platform->now(&start);
+      rc = lockdown(&lock);
+      platform->now(&end);
+      simulation_stop();
+      
+      if (rc)
+	return fprintf(stderr, "%s: cycle %zu: the lock failed\n", *argv, i), 1;
+      if (sim.kbmode != K_XLATE)
+	return fprintf(stderr, "%s: cycle %zu: the keyboard mode was not restored\n", *argv, i), 1;
+      if (memcmp(&attr, &sim.attr, sizeof(attr)))
+	return fprintf(stderr, "%s: cycle %zu: the terminal attributes were not restored\n", *argv, i), 1;
+      /* the release of the last Enter is not read, the guard spawns
+       * the attempts, and each attempt spawns a verifier */
+      if ((sim.input_ptr + 1 != n) || (sim.spawned != 5))
+	return fprintf(stderr, "%s: cycle %zu: the attempts were not both read\n", *argv, i), 1;
+      if ((sim.clock.tv_sec == 0) && (sim.clock.tv_nsec == 0))
+	return fprintf(stderr, "%s: cycle %zu: the wrong attempt was not delayed\n", *argv, i), 1;
+      
+      latencies[i] = test_elapsed(&start, &end);
+      latencies[i] -= (long long)(sim.clock.tv_sec) * 1000000000LL + (long long)(sim.clock.tv_nsec);
+      total += latencies[i];
+    }
+  
+  /* a passphrase that is changed while locked works on the first attempt */
+  lock.refresh = changed;
+  lock.encrypted = "$1$lockdown$outdated.outdated.outda";
+  n = test_type(TEST_PASSPHRASE "\n", input);
+  simulation_start(&sim, input, n);
+  rc = lockdown(&lock);
+  simulation_stop();
+  if (rc || (sim.spawned != 3))
+    return fprintf(stderr, "%s: the changed passphrase was not used\n", *argv), 1;
+  
+  /* a passphrase that is revoked while locked is not accepted, the
+   * attempt fails as a wrong one, and the keyboard is lost after it */
+  lock.refresh = revoked;
+  lock.encrypted = test_encrypted();
+  n = test_type(TEST_PASSPHRASE "\n", input);
+  simulation_start(&sim, input, n);
+  rc = lockdown(&lock);
+  simulation_stop();
+  if ((rc != -1) || (sim.clock.tv_sec == 0))
+    return fprintf(stderr, "%s: the revoked passphrase was accepted\n", *argv), 1;
+  
+  /* a keyboard that is lost mid-line fails the lock, without the
+   * partial line being verified and delayed as a wrong attempt */
+  lock.refresh = NULL;
+  n = test_type("wro", input);
+  simulation_start(&sim, input, n);
+  rc = lockdown(&lock);
+  simulation_stop();
+  if ((rc != -1) || sim.clock.tv_sec || sim.clock.tv_nsec)
+    return fprintf(stderr, "%s: the partial line was verified when the keyboard was lost\n", *argv), 1;
+  
+  qsort(latencies, cycles, sizeof(*latencies), compare);
+  printf("%zu cycles, %.0f cycles/s\n", cycles, (double)cycles * (double)1000000000LL / (double)(total ? total : 1));
+  printf("latency: mean %lld ns, p50 %lld ns, p99 %lld ns, max %lld ns\n",
+	 total / (long long)cycles, latencies[cycles / 2], latencies[cycles * 99 / 100], latencies[cycles - 1]);
+  free(latencies);
+  return 0;
+}
+